@@ -0,0 +1,76 @@
+#include "alloc.h"
+#include "page.h"
+
+#define ALIGN(_n) (((_n) + ALLOC_ALIGN - 1) & ~(size_t) (ALLOC_ALIGN - 1))
+
+bool arena_init(struct Arena *arena, size_t size) {
+    *arena = (struct Arena) { 0 };
+    arena->base = page_alloc(PAGES(size));
+    if (arena->base == NULL) {
+        return false;
+    }
+
+    arena->size = PAGES(size) * PAGE_SIZE;
+    return true;
+}
+
+void *arena_alloc(struct Arena *arena, size_t n) {
+    n = ALIGN(n);
+    if (n > arena->size - arena->used) {
+        arena->failures++;
+        return NULL;
+    }
+
+    void *p = arena->base + arena->used;
+    arena->used += n;
+    arena->peak = MAX(arena->peak, arena->used);
+    return p;
+}
+
+void arena_reset(struct Arena *arena) {
+    arena->used = 0;
+}
+
+bool pool_init(struct Pool *pool, size_t block_size, size_t count) {
+    *pool = (struct Pool) { 0 };
+
+    // a free block holds the pointer to the next one
+    block_size = ALIGN(MAX(block_size, sizeof(void *)));
+    pool->base = page_alloc(PAGES(block_size * count));
+    if (pool->base == NULL) {
+        return false;
+    }
+
+    pool->block_size = block_size;
+    pool->count = count;
+    for (size_t i = count; i > 0; i--) {
+        void **block = (void **) (pool->base + (i - 1) * block_size);
+        *block = pool->free;
+        pool->free = block;
+    }
+
+    return true;
+}
+
+void *pool_alloc(struct Pool *pool) {
+    void **block = pool->free;
+    if (block == NULL) {
+        pool->failures++;
+        return NULL;
+    }
+
+    pool->free = *block;
+    pool->used++;
+    pool->peak = MAX(pool->peak, pool->used);
+    return block;
+}
+
+void pool_free(struct Pool *pool, void *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    *(void **) p = pool->free;
+    pool->free = p;
+    pool->used--;
+}
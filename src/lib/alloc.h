@@ -0,0 +1,41 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include "util.h"
+
+// alignment of everything handed out, enough for any scalar
+#define ALLOC_ALIGN 16
+
+// bump allocator for scratch memory that is dropped all at once, e.g. at the
+// start of every frame
+struct Arena {
+    u8 *base;
+    size_t size, used;
+
+    // most bytes in use since arena_init, and allocations that did not fit
+    size_t peak;
+    u32 failures;
+};
+
+// fixed size blocks with O(1) alloc and free through a free list threaded
+// through the unused blocks
+struct Pool {
+    u8 *base;
+    size_t block_size, count;
+    void *free;
+
+    // blocks in use, the most ever in use, and allocations that did not fit
+    size_t used, peak;
+    u32 failures;
+};
+
+// memory for both comes from the page allocator, returns false without it
+bool arena_init(struct Arena *arena, size_t size);
+void *arena_alloc(struct Arena *arena, size_t n);
+void arena_reset(struct Arena *arena);
+
+bool pool_init(struct Pool *pool, size_t block_size, size_t count);
+void *pool_alloc(struct Pool *pool);
+void pool_free(struct Pool *pool, void *p);
+
+#endif
@@ -0,0 +1,405 @@
+#include "ata.h"
+#include "irq.h"
+#include "pci.h"
+
+// SEE: https://wiki.osdev.org/ATA_PIO_Mode
+#define ATA_IO   0x1F0
+#define ATA_CTRL 0x3F6
+#define ATA_IRQ  14
+
+#define ATA_DATA         (ATA_IO + 0)
+#define ATA_SECTOR_COUNT (ATA_IO + 2)
+#define ATA_LBA_LO       (ATA_IO + 3)
+#define ATA_LBA_MID      (ATA_IO + 4)
+#define ATA_LBA_HI       (ATA_IO + 5)
+#define ATA_DRIVE        (ATA_IO + 6)
+#define ATA_STATUS       (ATA_IO + 7)
+#define ATA_COMMAND      (ATA_IO + 7)
+
+#define STATUS_ERR  0x01
+#define STATUS_DRQ  0x08
+#define STATUS_DF   0x20
+#define STATUS_BSY  0x80
+
+#define DRIVE_LBA   0xE0
+#define DRIVE_SLAVE 0x10
+#define CTRL_NIEN   0x02
+
+#define CMD_READ_SECTORS     0x20
+#define CMD_READ_SECTORS_EXT 0x24
+#define CMD_READ_DMA         0xC8
+#define CMD_READ_DMA_EXT     0x25
+#define CMD_IDENTIFY         0xEC
+
+// IDENTIFY words
+#define ID_CAPABILITIES  49
+#define ID_SECTORS_28    60
+#define ID_COMMAND_SETS  83
+#define ID_SECTORS_48    100
+#define ID_DMA           (1 << 8)
+#define ID_LBA48         (1 << 10)
+
+#define LBA28_LIMIT (1 << 28)
+
+// most sectors per command, LBA28 encodes 256 as a count of 0
+#define MAX_TRANSFER 256
+
+// status reads needed to wait out the 400ns after selecting a drive
+#define SELECT_DELAY 4
+
+// SEE: https://wiki.osdev.org/ATA/ATAPI_using_DMA
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE  0x01
+#define PCI_IDE_PRIMARY_NATIVE 0x01
+#define PCI_IDE_BUS_MASTER     0x80
+#define PCI_BAR_BUS_MASTER 4
+
+// primary channel bus master registers, relative to BAR4
+#define BM_COMMAND 0
+#define BM_STATUS  2
+#define BM_PRDT    4
+
+#define BM_COMMAND_START 0x01
+#define BM_COMMAND_READ  0x08
+#define BM_STATUS_ERROR  0x02
+#define BM_STATUS_IRQ    0x04
+
+// physical region descriptors may not cross 64K, so 256 sectors need 3
+#define PRD_EOT 0x8000
+#define PRD_MAX 4
+
+struct Prd {
+    u32 addr;
+    u16 size;
+    u16 flags;
+} PACKED;
+
+struct AtaDrive {
+    struct BlockDevice dev;
+    bool slave, lba48, dma;
+};
+
+static struct AtaDrive drives[2] = {
+    { .dev = { .name = "ATA0" }, .slave = false },
+    { .dev = { .name = "ATA1" }, .slave = true }
+};
+
+// bus master I/O base, 0 without a DMA capable controller
+static u16 bm = 0;
+
+// aligned so the table never crosses 64K itself
+static struct Prd prdt[PRD_MAX] __attribute__((aligned(32)));
+
+// requests waiting for DMA, the head is the one running
+static struct BlockRequest *volatile head = NULL, *tail = NULL;
+
+// a PIO read owns the channel, queued DMA waits until it is done
+static volatile bool pio_busy = false;
+
+static void delay() {
+    for (size_t i = 0; i < SELECT_DELAY; i++) {
+        inportb(ATA_STATUS);
+    }
+}
+
+// waits until the drive is not busy, returns the final status
+static u8 wait_ready() {
+    u8 status;
+    while ((status = inportb(ATA_STATUS)) & STATUS_BSY);
+    return status;
+}
+
+// waits for the next sector, returns false on errors
+static bool wait_data() {
+    delay();
+    u8 status = wait_ready();
+    return !(status & (STATUS_ERR | STATUS_DF)) && (status & STATUS_DRQ);
+}
+
+static void read_sector(u16 *dst) {
+    for (size_t i = 0; i < BLOCK_SECTOR_SIZE / 2; i++) {
+        dst[i] = inports(ATA_DATA);
+    }
+}
+
+// issues a read command, LBA28 where it reaches as it is one register write
+// less per command. returns false if the drive can not address lba
+static bool command(struct AtaDrive *drive, u64 lba, size_t count, u8 cmd28, u8 cmd48) {
+    u8 select = DRIVE_LBA | (drive->slave ? DRIVE_SLAVE : 0);
+
+    wait_ready();
+
+    if (lba + count <= LBA28_LIMIT) {
+        outportb(ATA_DRIVE, select | ((lba >> 24) & 0x0F));
+        outportb(ATA_SECTOR_COUNT, (u8) count);
+        outportb(ATA_LBA_LO, lba & 0xFF);
+        outportb(ATA_LBA_MID, (lba >> 8) & 0xFF);
+        outportb(ATA_LBA_HI, (lba >> 16) & 0xFF);
+        outportb(ATA_COMMAND, cmd28);
+    } else if (drive->lba48) {
+        // high bytes first, each register holds two
+        outportb(ATA_DRIVE, select);
+        outportb(ATA_SECTOR_COUNT, (count >> 8) & 0xFF);
+        outportb(ATA_LBA_LO, (lba >> 24) & 0xFF);
+        outportb(ATA_LBA_MID, (lba >> 32) & 0xFF);
+        outportb(ATA_LBA_HI, (lba >> 40) & 0xFF);
+        outportb(ATA_SECTOR_COUNT, count & 0xFF);
+        outportb(ATA_LBA_LO, lba & 0xFF);
+        outportb(ATA_LBA_MID, (lba >> 8) & 0xFF);
+        outportb(ATA_LBA_HI, (lba >> 16) & 0xFF);
+        outportb(ATA_COMMAND, cmd48);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static bool identify(struct AtaDrive *drive) {
+    static u16 id[BLOCK_SECTOR_SIZE / 2];
+
+    outportb(ATA_DRIVE, DRIVE_LBA | (drive->slave ? DRIVE_SLAVE : 0));
+    delay();
+
+    outportb(ATA_SECTOR_COUNT, 0);
+    outportb(ATA_LBA_LO, 0);
+    outportb(ATA_LBA_MID, 0);
+    outportb(ATA_LBA_HI, 0);
+    outportb(ATA_COMMAND, CMD_IDENTIFY);
+
+    // no drive
+    if (inportb(ATA_STATUS) == 0) {
+        return false;
+    }
+
+    wait_ready();
+
+    // ATAPI and SATA devices identify themselves through the LBA registers
+    if (inportb(ATA_LBA_MID) != 0 || inportb(ATA_LBA_HI) != 0) {
+        return false;
+    }
+
+    if (!wait_data()) {
+        return false;
+    }
+
+    read_sector(id);
+
+    drive->dma = (id[ID_CAPABILITIES] & ID_DMA) != 0;
+    drive->lba48 = (id[ID_COMMAND_SETS] & ID_LBA48) != 0;
+    drive->dev.sectors = drive->lba48 ?
+        (id[ID_SECTORS_48] | ((u64) id[ID_SECTORS_48 + 1] << 16)
+            | ((u64) id[ID_SECTORS_48 + 2] << 32) | ((u64) id[ID_SECTORS_48 + 3] << 48))
+        : (id[ID_SECTORS_28] | ((u32) id[ID_SECTORS_28 + 1] << 16));
+    return drive->dev.sectors != 0;
+}
+
+static bool pio_read(struct AtaDrive *drive, u64 lba, size_t count, void *dst) {
+    if (!command(drive, lba, count, CMD_READ_SECTORS, CMD_READ_SECTORS_EXT)) {
+        return false;
+    }
+
+    u16 *p = dst;
+    for (size_t i = 0; i < count; i++) {
+        if (!wait_data()) {
+            return false;
+        }
+
+        read_sector(p);
+        p += BLOCK_SECTOR_SIZE / 2;
+    }
+
+    return true;
+}
+
+// starts the request at the head of the queue, called with interrupts off
+static void dma_start(struct BlockRequest *req) {
+    struct AtaDrive *drive = (struct AtaDrive *) req->dev;
+
+    // memory is identity mapped, so dst is also the physical address
+    u32 addr = (uintptr_t) req->dst,
+        left = req->count * BLOCK_SECTOR_SIZE;
+    size_t n = 0;
+    while (left != 0) {
+        u32 size = MIN(left, 0x10000 - (addr & 0xFFFF));
+        prdt[n++] = (struct Prd) {
+            .addr = addr,
+            .size = size & 0xFFFF, // 0 is 64K
+            .flags = 0
+        };
+
+        addr += size;
+        left -= size;
+    }
+    prdt[n - 1].flags = PRD_EOT;
+
+    outportb(bm + BM_COMMAND, 0);
+    outportl(bm + BM_PRDT, (uintptr_t) prdt);
+    outportb(bm + BM_COMMAND, BM_COMMAND_READ);
+
+    // writing the status back clears the error and interrupt bits
+    outportb(bm + BM_STATUS, inportb(bm + BM_STATUS));
+
+    if (!command(drive, req->lba, req->count, CMD_READ_DMA, CMD_READ_DMA_EXT)) {
+        // nothing was started, so no interrupt will finish it
+        req->failed = true;
+        req->done = true;
+        head = req->next;
+        if (head == NULL) {
+            tail = NULL;
+        } else {
+            dma_start(head);
+        }
+
+        return;
+    }
+
+    outportb(bm + BM_COMMAND, BM_COMMAND_READ | BM_COMMAND_START);
+}
+
+static void ata_irq(struct Registers *regs) {
+    u8 bm_status = inportb(bm + BM_STATUS);
+    if (!(bm_status & BM_STATUS_IRQ)) {
+        return;
+    }
+
+    outportb(bm + BM_COMMAND, 0);
+
+    // reading the status acknowledges the drive's interrupt
+    u8 status = inportb(ATA_STATUS);
+    outportb(bm + BM_STATUS, bm_status);
+
+    // PIO commands also interrupt, but only run with nothing started
+    struct BlockRequest *req = head;
+    if (req == NULL || pio_busy) {
+        return;
+    }
+
+    head = req->next;
+    if (head == NULL) {
+        tail = NULL;
+    }
+
+    req->failed = (bm_status & BM_STATUS_ERROR) || (status & (STATUS_ERR | STATUS_DF));
+    req->done = true;
+
+    // keep the disk busy with the next request right away
+    if (head != NULL) {
+        dma_start(head);
+    }
+}
+
+static bool ata_submit(struct BlockDevice *dev, struct BlockRequest *req) {
+    // PRDs need an even address
+    if ((uintptr_t) req->dst & 1) {
+        return false;
+    }
+
+    CLI();
+    if (tail == NULL) {
+        head = tail = req;
+        if (!pio_busy) {
+            dma_start(req);
+        }
+    } else {
+        tail->next = req;
+        tail = req;
+    }
+    STI();
+
+    return true;
+}
+
+static bool ata_read(struct BlockDevice *dev, u64 lba, size_t count, void *dst) {
+    struct AtaDrive *drive = (struct AtaDrive *) dev;
+    if (count == 0 || count > MAX_TRANSFER) {
+        return false;
+    }
+
+    if (dev->submit != NULL) {
+        struct BlockRequest req = { .lba = lba, .count = count, .dst = dst };
+        if (block_submit(dev, &req)) {
+            while (!req.done);
+            return !req.failed;
+        }
+
+    }
+
+    // the channel is shared with DMA on the other drive. wait for the queue
+    // to drain, then hold new requests back until the PIO read is done
+    for (;;) {
+        CLI();
+        if (head == NULL) {
+            break;
+        }
+
+        STI();
+        while (head != NULL);
+    }
+
+    pio_busy = true;
+    STI();
+
+    bool ok = pio_read(drive, lba, count, dst);
+
+    CLI();
+    pio_busy = false;
+    if (head != NULL) {
+        dma_start(head);
+    }
+    STI();
+
+    return ok;
+}
+
+// finds the PCI IDE controller, returns false if it can not do bus master DMA
+// on the primary channel at the legacy ports
+static bool dma_init() {
+    struct PciDevice pci;
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, 0, &pci)
+            || (pci.prog_if & PCI_IDE_PRIMARY_NATIVE)
+            || !(pci.prog_if & PCI_IDE_BUS_MASTER)) {
+        return false;
+    }
+
+    u32 bar = pci_bar(&pci, PCI_BAR_BUS_MASTER);
+    if (!(bar & PCI_BAR_IO) || (bar & PCI_BAR_IO_MASK) == 0) {
+        return false;
+    }
+
+    bm = bar & PCI_BAR_IO_MASK;
+    pci_enable(&pci, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    return true;
+}
+
+size_t ata_init() {
+    // floating bus, no controller
+    if (inportb(ATA_STATUS) == 0xFF) {
+        return 0;
+    }
+
+    // probe with the interrupt off, it is only used for DMA
+    outportb(ATA_CTRL, CTRL_NIEN);
+
+    bool dma = dma_init();
+    size_t found = 0;
+    for (size_t i = 0; i < 2; i++) {
+        struct AtaDrive *drive = &drives[i];
+        if (!identify(drive)) {
+            continue;
+        }
+
+        drive->dev.max_transfer = MAX_TRANSFER;
+        drive->dev.read = ata_read;
+        drive->dev.submit = dma && drive->dma ? ata_submit : NULL;
+        block_register(&drive->dev);
+        found++;
+    }
+
+    if (dma) {
+        irq_install(ATA_IRQ, ata_irq);
+        outportb(ATA_CTRL, 0);
+    }
+
+    return found;
+}
@@ -0,0 +1,11 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "util.h"
+#include "block.h"
+
+// probes master and slave on the primary channel, registers every ATA disk
+// found as block device. returns the number of disks
+size_t ata_init();
+
+#endif
@@ -0,0 +1,58 @@
+#include "block.h"
+
+static struct BlockDevice *devices[BLOCK_MAX_DEVICES];
+static size_t count = 0;
+
+void block_register(struct BlockDevice *dev) {
+    if (count < BLOCK_MAX_DEVICES) {
+        devices[count++] = dev;
+    }
+}
+
+size_t block_count() {
+    return count;
+}
+
+struct BlockDevice *block_get(size_t i) {
+    return i < count ? devices[i] : NULL;
+}
+
+bool block_read(struct BlockDevice *dev, u64 lba, size_t n, void *dst) {
+    if (lba + n > dev->sectors) {
+        return false;
+    }
+
+    u8 *p = dst;
+    while (n != 0) {
+        size_t batch = MIN(n, dev->max_transfer);
+        if (!dev->read(dev, lba, batch, p)) {
+            return false;
+        }
+
+        lba += batch;
+        n -= batch;
+        p += batch * BLOCK_SECTOR_SIZE;
+    }
+
+    return true;
+}
+
+bool block_submit(struct BlockDevice *dev, struct BlockRequest *req) {
+    req->done = false;
+    req->failed = false;
+    req->dev = dev;
+    req->next = NULL;
+
+    if (req->count == 0 || req->count > dev->max_transfer
+            || req->lba + req->count > dev->sectors) {
+        return false;
+    }
+
+    if (dev->submit != NULL) {
+        return dev->submit(dev, req);
+    }
+
+    req->failed = !dev->read(dev, req->lba, req->count, req->dst);
+    req->done = true;
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "util.h"
+
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_MAX_DEVICES 8
+
+// a read that completes in the background, see block_submit
+struct BlockRequest {
+    u64 lba;
+    size_t count;
+    void *dst;
+
+    // set once the request is finished, from the interrupt handler
+    volatile bool done, failed;
+
+    // set by block_submit, for the driver
+    struct BlockDevice *dev;
+    struct BlockRequest *next;
+};
+
+// a run of consecutive sectors, e.g. part of a file
+struct BlockExtent {
+    u64 lba;
+    u64 count;
+};
+
+// a disk the kernel can read from, registered by its driver
+struct BlockDevice {
+    const char *name;
+
+    // capacity in BLOCK_SECTOR_SIZE sectors
+    u64 sectors;
+
+    // most sectors a single read may ask for
+    size_t max_transfer;
+
+    // reads count (1..max_transfer) sectors, returns false on error
+    bool (*read)(struct BlockDevice *dev, u64 lba, size_t count, void *dst);
+
+    // queues a read of count (1..max_transfer) sectors and returns right away,
+    // NULL if the device can only read synchronously
+    bool (*submit)(struct BlockDevice *dev, struct BlockRequest *req);
+};
+
+void block_register(struct BlockDevice *dev);
+size_t block_count();
+struct BlockDevice *block_get(size_t i);
+
+// reads any number of sectors, split into transfers the device supports
+bool block_read(struct BlockDevice *dev, u64 lba, size_t count, void *dst);
+
+// starts a read in the background, or does it right away if the device has
+// no queue. returns false if the request could not be started
+bool block_submit(struct BlockDevice *dev, struct BlockRequest *req);
+
+#endif
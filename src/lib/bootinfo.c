@@ -0,0 +1,15 @@
+#include "bootinfo.h"
+
+// placed at BOOT_INFO_ADDR by link.ld
+extern struct BootInfo boot_info;
+
+static const struct BootInfo *info = NULL;
+
+void bootinfo_init(bool stage0) {
+    info = stage0 && boot_info.magic == BOOT_INFO_MAGIC
+        && boot_info.image->magic == IMAGE_MAGIC ? &boot_info : NULL;
+}
+
+const struct BootInfo *bootinfo_get() {
+    return info;
+}
@@ -0,0 +1,60 @@
+#ifndef BOOTINFO_H
+#define BOOTINFO_H
+
+#include "util.h"
+
+// written by stage0 next to the boot log, must match stage0.S
+#define BOOT_INFO_ADDR 0x600
+#define BOOT_INFO_MAGIC 0x464E4942
+
+#define BOOT_INFO_MMAP_MAX 32
+
+// INT 15h E820h memory map entry types
+#define E820_AVAILABLE 1
+
+struct E820Entry {
+    u64 base, length;
+    u32 type;
+    u32 acpi;
+} PACKED;
+
+// image header, see tools/mkimage.c
+#define IMAGE_MAGIC 0x534F4142
+
+struct ImageSegment {
+    u32 addr;
+    u32 file_size, mem_size;
+
+    // file bytes loaded by stage0, the rest is left on disk
+    u32 boot_size;
+} PACKED;
+
+struct ImageHeader {
+    u32 magic;
+    u32 entry;
+    u32 segment_count;
+    u32 clip;
+    struct ImageSegment segments[];
+} PACKED;
+
+struct BootInfo {
+    u32 magic;
+
+    // BIOS drive number stage0 was loaded from
+    u32 drive;
+
+    // first sector of the image, holding the header
+    u32 image_sector;
+    const struct ImageHeader *image;
+
+    // E820 memory map, empty if the BIOS does not support it
+    u32 mmap_count;
+    u32 __reserved[3];
+    struct E820Entry mmap[BOOT_INFO_MMAP_MAX];
+} PACKED;
+
+// returns NULL unless the kernel was loaded by stage0
+void bootinfo_init(bool stage0);
+const struct BootInfo *bootinfo_get();
+
+#endif
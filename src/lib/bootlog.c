@@ -0,0 +1,122 @@
+#include "bootlog.h"
+#include "font.h"
+#include "serial.h"
+#include "timer.h"
+
+#define CALIBRATION_TICKS 16
+
+// placed at BOOT_LOG_ADDR by link.ld
+extern struct BootLog boot_log;
+
+// TSC ticks per millisecond, 0 until calibrated
+static u32 tsc_per_ms = 0;
+
+static const char *PHASE_NAMES[BOOT_PHASES] = {
+    "BIOS",
+    "STAGE0",
+    "A20",
+    "DISK PARAMS",
+    "LOAD IMAGE",
+    "VIDEO MODE",
+    "PROTECTED",
+    "KERNEL",
+    "DECOMPRESS",
+    "MEMORY",
+    "IDT",
+    "ISR",
+    "IRQ",
+    "SCREEN",
+    "TIMER",
+    "KEYBOARD",
+    "MUSIC",
+    "READY"
+};
+
+void bootlog_init(bool stage0) {
+    if (!stage0 || boot_log.magic != BOOT_LOG_MAGIC) {
+        memset(&boot_log, 0, sizeof(boot_log));
+        boot_log.magic = BOOT_LOG_MAGIC;
+    }
+}
+
+void bootlog_mark(enum BootPhase phase) {
+    boot_log.tsc[phase] = rdtsc();
+}
+
+void bootlog_calibrate() {
+    // align to a tick edge first, then count TSC ticks over a few timer ticks
+    u64 start = timer_get();
+    while (timer_get() == start);
+
+    u64 tsc = rdtsc();
+    start = timer_get();
+    while (timer_get() - start < CALIBRATION_TICKS);
+
+    tsc_per_ms = (u32) udiv64((rdtsc() - tsc) * TIMER_TPS, CALIBRATION_TICKS * 1000);
+}
+
+u32 bootlog_us(u64 cycles) {
+    return tsc_per_ms != 0 ? (u32) udiv64(cycles * 1000, tsc_per_ms) : 0;
+}
+
+// writes the line for a phase to buf, returns false if it was not recorded.
+// each phase is named after what ran up to it, so the first one (BIOS) is the
+// time since reset
+static bool format_phase(enum BootPhase phase, u64 *last, char *buf, size_t n) {
+    char num[32];
+
+    if (boot_log.tsc[phase] == 0) {
+        return false;
+    }
+
+    u64 delta = boot_log.tsc[phase] - *last;
+    *last = boot_log.tsc[phase];
+
+    strlcpy(buf, PHASE_NAMES[phase], n);
+    while (strlen(buf) < 12) {
+        strlcat(buf, " ", n);
+    }
+
+    if (tsc_per_ms != 0) {
+        itoa((i32) udiv64(delta * 1000, tsc_per_ms), num, sizeof(num));
+        strlcat(buf, num, n);
+        strlcat(buf, " us", n);
+    } else {
+        itoa((i32) udiv64(delta, 1000), num, sizeof(num));
+        strlcat(buf, num, n);
+        strlcat(buf, "k cycles", n);
+    }
+
+    return true;
+}
+
+size_t bootlog_draw(size_t x, size_t y, u8 color) {
+    char buf[64];
+    size_t lines = 0;
+    u64 last = 0;
+
+    for (size_t i = 0; i < BOOT_PHASES; i++) {
+        if (format_phase(i, &last, buf, sizeof(buf))) {
+            font_str(buf, x, y, color);
+            y += font_height() + 1;
+            lines++;
+        }
+    }
+
+    return lines;
+}
+
+void bootlog_dump() {
+#ifdef BOOTLOG_SERIAL
+    char buf[64];
+    u64 last = 0;
+
+    serial_write("boot log:\n");
+    for (size_t i = 0; i < BOOT_PHASES; i++) {
+        if (format_phase(i, &last, buf, sizeof(buf))) {
+            serial_write(buf);
+            serial_write("\n");
+        }
+    }
+#endif
+}
@@ -0,0 +1,62 @@
+#ifndef BOOTLOG_H
+#define BOOTLOG_H
+
+#include "util.h"
+
+// also dump the boot log to the serial port
+#define BOOTLOG_SERIAL
+
+// the log lives in low memory so stage0 can write it before the kernel is
+// loaded. address and phase numbers must match stage0.S and start.S
+#define BOOT_LOG_ADDR 0x500
+#define BOOT_LOG_MAGIC 0x474F4C42
+
+enum BootPhase {
+    // stage0.S
+    BOOT_STAGE0,
+    BOOT_STAGE1,
+    BOOT_A20,
+    BOOT_DISK,
+    BOOT_LOADED,
+    BOOT_VIDEO,
+    BOOT_PROTECTED,
+
+    // start.S
+    BOOT_KERNEL,
+
+    // main.c
+    BOOT_MAIN,
+    BOOT_MEMORY,
+    BOOT_IDT,
+    BOOT_ISR,
+    BOOT_IRQ,
+    BOOT_SCREEN,
+    BOOT_TIMER,
+    BOOT_KEYBOARD,
+    BOOT_MUSIC,
+    BOOT_READY,
+
+    BOOT_PHASES
+};
+
+struct BootLog {
+    u32 magic;
+    u32 __reserved;
+    u64 tsc[BOOT_PHASES];
+} PACKED;
+
+// stage0 entries are discarded unless the kernel was loaded by stage0
+void bootlog_init(bool stage0);
+void bootlog_mark(enum BootPhase phase);
+
+// measures the TSC frequency, needs the timer
+void bootlog_calibrate();
+
+// converts TSC cycles to microseconds, 0 before bootlog_calibrate
+u32 bootlog_us(u64 cycles);
+
+// draws the time spent in each phase, returns the number of lines drawn
+size_t bootlog_draw(size_t x, size_t y, u8 color);
+void bootlog_dump();
+
+#endif
@@ -0,0 +1,406 @@
+#include "cache.h"
+#include "page.h"
+#include "timer.h"
+#include "font.h"
+#include "serial.h"
+
+enum BlockState {
+    EMPTY,
+    LOADING,
+    VALID
+};
+
+struct CacheBlock {
+    struct BlockDevice *dev;
+    u64 block;
+    u8 *data;
+    enum BlockState state;
+
+    // loaded by read-ahead and not used yet
+    bool readahead;
+
+    struct BlockRequest req;
+    struct CacheBlock *hash_next;
+
+    // most recently used first
+    struct CacheBlock *prev, *next;
+};
+
+static struct CacheBlock blocks[CACHE_BLOCKS];
+static struct CacheBlock *buckets[CACHE_BUCKETS];
+static struct CacheBlock *lru_head = NULL, *lru_tail = NULL;
+static bool enabled = false;
+
+static struct CacheStats stats;
+
+// end of the last read, to detect sequential access
+static struct BlockDevice *last_dev = NULL;
+static u64 last_end = 0;
+
+// bytes served since rate_start
+static u32 rate_bytes = 0;
+static u64 rate_start = 0;
+
+static size_t bucket(struct BlockDevice *dev, u64 block) {
+    return ((u32) block ^ ((uintptr_t) dev >> 4)) % CACHE_BUCKETS;
+}
+
+static void lru_remove(struct CacheBlock *b) {
+    if (b->prev != NULL) {
+        b->prev->next = b->next;
+    } else {
+        lru_head = b->next;
+    }
+
+    if (b->next != NULL) {
+        b->next->prev = b->prev;
+    } else {
+        lru_tail = b->prev;
+    }
+
+    b->prev = b->next = NULL;
+}
+
+static void lru_push(struct CacheBlock *b) {
+    b->prev = NULL;
+    b->next = lru_head;
+    if (lru_head != NULL) {
+        lru_head->prev = b;
+    }
+
+    lru_head = b;
+    if (lru_tail == NULL) {
+        lru_tail = b;
+    }
+}
+
+static void hash_remove(struct CacheBlock *b) {
+    struct CacheBlock **p = &buckets[bucket(b->dev, b->block)];
+    while (*p != NULL && *p != b) {
+        p = &(*p)->hash_next;
+    }
+
+    if (*p != NULL) {
+        *p = b->hash_next;
+    }
+}
+
+static struct CacheBlock *lookup(struct BlockDevice *dev, u64 block) {
+    for (struct CacheBlock *b = buckets[bucket(dev, block)]; b != NULL; b = b->hash_next) {
+        if (b->dev == dev && b->block == block && b->state != EMPTY) {
+            return b;
+        }
+    }
+
+    return NULL;
+}
+
+// settles a block that finished loading, returns false if it failed
+static bool settle(struct CacheBlock *b) {
+    if (b->state == LOADING && b->req.done) {
+        if (b->req.failed) {
+            hash_remove(b);
+            b->state = EMPTY;
+            return false;
+        }
+
+        b->state = VALID;
+    }
+
+    return b->state != EMPTY;
+}
+
+// takes the least recently used block that is not being loaded, NULL if
+// every block is in flight
+static struct CacheBlock *evict() {
+    struct CacheBlock *b = lru_tail;
+    while (b != NULL) {
+        // read-ahead that finished but was never looked up still reads
+        // as LOADING, so settle it before deciding it is in flight
+        settle(b);
+        if (b->state != LOADING) {
+            break;
+        }
+
+        b = b->prev;
+    }
+
+    if (b == NULL) {
+        return NULL;
+    }
+
+    if (b->state == VALID) {
+        hash_remove(b);
+        stats.evictions++;
+    }
+
+    b->state = EMPTY;
+    b->readahead = false;
+    return b;
+}
+
+// starts loading a block, returns NULL if there is no room
+static struct CacheBlock *load(struct BlockDevice *dev, u64 block, bool wait) {
+    u64 lba = block * CACHE_BLOCK_SECTORS;
+    if (lba >= dev->sectors) {
+        return NULL;
+    }
+
+    struct CacheBlock *b = evict();
+    if (b == NULL) {
+        return NULL;
+    }
+
+    b->dev = dev;
+    b->block = block;
+    b->state = LOADING;
+    b->hash_next = buckets[bucket(dev, block)];
+    buckets[bucket(dev, block)] = b;
+
+    lru_remove(b);
+    lru_push(b);
+
+    // the last block of a device may be short
+    b->req = (struct BlockRequest) {
+        .lba = lba,
+        .count = MIN((u64) CACHE_BLOCK_SECTORS, dev->sectors - lba),
+        .dst = b->data
+    };
+
+    if (!block_submit(dev, &b->req)) {
+        hash_remove(b);
+        b->state = EMPTY;
+        return NULL;
+    }
+
+    if (wait) {
+        while (!b->req.done);
+    }
+
+    return b;
+}
+
+// returns the block, loaded, NULL on read errors
+static struct CacheBlock *get(struct BlockDevice *dev, u64 block) {
+    struct CacheBlock *b = lookup(dev, block);
+    if (b != NULL) {
+        stats.hits++;
+        while (!b->req.done && b->state == LOADING);
+
+        if (b->readahead) {
+            stats.readahead_hits++;
+            b->readahead = false;
+        }
+    } else {
+        stats.misses++;
+        b = load(dev, block, true);
+    }
+
+    if (b == NULL || !settle(b)) {
+        return NULL;
+    }
+
+    lru_remove(b);
+    lru_push(b);
+    return b;
+}
+
+// read-ahead window from the bytes served over the last second
+static size_t window() {
+    u64 now = timer_get();
+    if (now - rate_start >= TIMER_TPS) {
+        stats.rate = (u32) udiv64((u64) rate_bytes * TIMER_TPS, (u32) (now - rate_start));
+        rate_bytes = 0;
+        rate_start = now;
+    }
+
+    size_t n = stats.rate / 1000 * CACHE_READAHEAD_MS / CACHE_BLOCK_SIZE;
+    return CLAMP(n, (size_t) CACHE_READAHEAD_MIN, (size_t) CACHE_READAHEAD_MAX);
+}
+
+// whether sectors lba to lba + count are all on the device
+static bool in_range(struct BlockDevice *dev, u64 lba, size_t count) {
+    return lba <= dev->sectors && count <= dev->sectors - lba;
+}
+
+static void readahead(struct BlockDevice *dev, u64 block, size_t n) {
+    // never past the last block of the device
+    u64 blocks = (dev->sectors + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS;
+    if (block >= blocks) {
+        return;
+    }
+
+    n = MIN((u64) n, blocks - block);
+    stats.window = n;
+    for (size_t i = 0; i < n; i++) {
+        if (lookup(dev, block + i) != NULL) {
+            continue;
+        }
+
+        struct CacheBlock *b = load(dev, block + i, false);
+        if (b == NULL) {
+            break;
+        }
+
+        b->readahead = true;
+        stats.readahead++;
+    }
+}
+
+void cache_init() {
+    u8 *data = page_alloc(PAGES(CACHE_BLOCKS * CACHE_BLOCK_SIZE));
+    if (data == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < CACHE_BLOCKS; i++) {
+        blocks[i].data = data + i * CACHE_BLOCK_SIZE;
+        blocks[i].state = EMPTY;
+        lru_push(&blocks[i]);
+    }
+
+    rate_start = timer_get();
+    enabled = true;
+}
+
+bool cache_read(struct BlockDevice *dev, u64 lba, size_t count, void *dst) {
+    // e.g. a bad extent, the drivers are never asked for sectors that are not there
+    if (!in_range(dev, lba, count)) {
+        return false;
+    }
+
+    if (!enabled) {
+        return block_read(dev, lba, count, dst);
+    }
+
+    u8 *p = dst;
+    for (u64 s = lba; s < lba + count;) {
+        u64 block = s / CACHE_BLOCK_SECTORS;
+        size_t offset = s % CACHE_BLOCK_SECTORS,
+            n = MIN((u64) (CACHE_BLOCK_SECTORS - offset), lba + count - s);
+
+        struct CacheBlock *b = get(dev, block);
+        if (b == NULL) {
+            return false;
+        }
+
+        memcpy(p, b->data + offset * BLOCK_SECTOR_SIZE, n * BLOCK_SECTOR_SIZE);
+        p += n * BLOCK_SECTOR_SIZE;
+        s += n;
+    }
+
+    rate_bytes += count * BLOCK_SECTOR_SIZE;
+
+    // sequential reads keep the blocks after them coming in
+    bool sequential = dev == last_dev && lba == last_end;
+    last_dev = dev;
+    last_end = lba + count;
+    if (sequential && dev->submit != NULL) {
+        readahead(dev, (lba + count + CACHE_BLOCK_SECTORS - 1) / CACHE_BLOCK_SECTORS, window());
+    }
+
+    return true;
+}
+
+bool cache_read_extents(struct BlockDevice *dev, const struct BlockExtent *extents, size_t n,
+        u64 first, size_t count, void *dst) {
+    u8 *p = dst;
+    for (size_t i = 0; i < n && count != 0; i++) {
+        if (first >= extents[i].count) {
+            first -= extents[i].count;
+            continue;
+        }
+
+        size_t batch = MIN((u64) count, extents[i].count - first);
+        if (!cache_read(dev, extents[i].lba + first, batch, p)) {
+            return false;
+        }
+
+        p += batch * BLOCK_SECTOR_SIZE;
+        count -= batch;
+        first = 0;
+    }
+
+    return count == 0;
+}
+
+bool cache_ready(struct BlockDevice *dev, u64 lba, size_t count) {
+    // cache_read reports what is out of range
+    if (!enabled || dev->submit == NULL || !in_range(dev, lba, count)) {
+        return true;
+    }
+
+    bool ready = true;
+    u64 first = lba / CACHE_BLOCK_SECTORS,
+        last = (lba + count - 1) / CACHE_BLOCK_SECTORS;
+    for (u64 block = first; block <= last; block++) {
+        struct CacheBlock *b = lookup(dev, block);
+        if (b != NULL && !settle(b)) {
+            // let cache_read retry it and report the error
+            return true;
+        }
+
+        if (b == NULL || b->state != VALID) {
+            ready = false;
+        }
+    }
+
+    // get the missing blocks, and what follows them, coming
+    if (!ready) {
+        readahead(dev, first, MAX(window(), (size_t) (last - first + 1)));
+    }
+
+    return ready;
+}
+
+const struct CacheStats *cache_stats() {
+    return &stats;
+}
+
+// writes the line for counter i to buf, returns false past the last one
+static bool format_stat(size_t i, char *buf, size_t n) {
+    static const char *NAMES[] = {
+        "HITS", "MISSES", "READAHEAD", "RA HITS", "EVICTIONS", "BYTES/S", "WINDOW"
+    };
+    const u32 values[] = {
+        stats.hits, stats.misses, stats.readahead, stats.readahead_hits,
+        stats.evictions, stats.rate, stats.window
+    };
+    char num[32];
+
+    if (i >= sizeof(values) / sizeof(values[0])) {
+        return false;
+    }
+
+    strlcpy(buf, NAMES[i], n);
+    while (strlen(buf) < 10) {
+        strlcat(buf, " ", n);
+    }
+
+    itoa((i32) values[i], num, sizeof(num));
+    strlcat(buf, num, n);
+    return true;
+}
+
+size_t cache_draw(size_t x, size_t y, u8 color) {
+    char buf[64];
+    size_t lines = 0;
+
+    for (size_t i = 0; format_stat(i, buf, sizeof(buf)); i++) {
+        font_str(buf, x, y, color);
+        y += font_height() + 1;
+        lines++;
+    }
+
+    return lines;
+}
+
+void cache_dump() {
+    char buf[64];
+
+    serial_write("block cache:\n");
+    for (size_t i = 0; format_stat(i, buf, sizeof(buf)); i++) {
+        serial_write(buf);
+        serial_write("\n");
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "util.h"
+#include "block.h"
+
+// 4K blocks, 256K in total
+#define CACHE_BLOCK_SECTORS 8
+#define CACHE_BLOCK_SIZE (CACHE_BLOCK_SECTORS * BLOCK_SECTOR_SIZE)
+#define CACHE_BLOCKS 64
+#define CACHE_BUCKETS 32
+
+// read-ahead covers this much time at the current read rate, in blocks
+#define CACHE_READAHEAD_MS 500
+#define CACHE_READAHEAD_MIN 2
+#define CACHE_READAHEAD_MAX (CACHE_BLOCKS / 2)
+
+struct CacheStats {
+    u32 hits, misses;
+
+    // blocks read ahead, and how many of them were used
+    u32 readahead, readahead_hits;
+    u32 evictions;
+
+    // bytes per second served, and the read-ahead window it gave
+    u32 rate, window;
+};
+
+// allocates the buffers, without them every read goes to the device
+void cache_init();
+
+// reads through the cache, blocking until all sectors are there. sequential
+// reads start read-ahead of the following blocks on devices with a queue.
+// returns false for sectors past the end of the device
+bool cache_read(struct BlockDevice *dev, u64 lba, size_t count, void *dst);
+
+// reads count sectors starting at sector first of data spread over n extents
+bool cache_read_extents(struct BlockDevice *dev, const struct BlockExtent *extents, size_t n,
+        u64 first, size_t count, void *dst);
+
+// returns false while these sectors are still being loaded in the background,
+// and requests the missing ones. devices without a queue are read directly by
+// cache_read, for them this is always true
+bool cache_ready(struct BlockDevice *dev, u64 lba, size_t count);
+
+const struct CacheStats *cache_stats();
+
+// shows the counters on screen, one per line starting at x, y. returns the
+// number of lines drawn
+size_t cache_draw(size_t x, size_t y, u8 color);
+
+// writes the counters to the serial port
+void cache_dump();
+
+#endif
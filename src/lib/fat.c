@@ -0,0 +1,256 @@
+#include "fat.h"
+#include "cache.h"
+
+#define BOOT_SIGNATURE 0xAA55
+#define MBR_PARTITIONS 0x1BE
+
+#define ENTRY_SIZE 32
+#define ENTRY_END 0x00
+#define ENTRY_DELETED 0xE5
+#define ATTR_VOLUME_ID 0x08
+#define ATTR_DIRECTORY 0x10
+
+#define FAT12_MAX_CLUSTERS 4084
+#define FAT16_MAX_CLUSTERS 65524
+
+struct BiosParameterBlock {
+    u8 jump[3];
+    char oem[8];
+    u16 bytes_per_sector;
+    u8 sectors_per_cluster;
+    u16 reserved_sectors;
+    u8 fat_count;
+    u16 root_entries;
+    u16 sectors16;
+    u8 media;
+    u16 fat_sectors;
+    u16 sectors_per_track;
+    u16 heads;
+    u32 hidden_sectors;
+    u32 sectors32;
+} PACKED;
+
+struct MbrPartition {
+    u8 status;
+    u8 chs_first[3];
+    u8 type;
+    u8 chs_last[3];
+    u32 lba;
+    u32 sectors;
+} PACKED;
+
+struct DirEntry {
+    char name[11];
+    u8 attributes;
+    u8 __reserved[8];
+    u16 cluster_high;
+    u16 time, date;
+    u16 cluster;
+    u32 size;
+} PACKED;
+
+static u8 sector[BLOCK_SECTOR_SIZE];
+
+static u16 get16(const u8 *p) {
+    return p[0] | (p[1] << 8);
+}
+
+// tries the BPB in the sector at lba, which is already in sector[]
+static bool mount_at(struct FatVolume *volume, struct BlockDevice *dev, u64 lba) {
+    const struct BiosParameterBlock *bpb = (const struct BiosParameterBlock *) sector;
+    if ((bpb->jump[0] != 0xEB && bpb->jump[0] != 0xE9)
+            || bpb->bytes_per_sector != BLOCK_SECTOR_SIZE
+            || bpb->sectors_per_cluster == 0
+            || (bpb->sectors_per_cluster & (bpb->sectors_per_cluster - 1)) != 0
+            || bpb->reserved_sectors == 0 || bpb->fat_count == 0
+            || bpb->fat_sectors == 0) {
+        return false;
+    }
+
+    u32 total = bpb->sectors16 != 0 ? bpb->sectors16 : bpb->sectors32,
+        root_sectors = (bpb->root_entries * ENTRY_SIZE + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE,
+        data = bpb->reserved_sectors + bpb->fat_count * bpb->fat_sectors + root_sectors;
+    if (data >= total || lba + total > dev->sectors) {
+        return false;
+    }
+
+    // the type follows from the number of clusters alone, FAT32 is not supported
+    volume->clusters = (total - data) / bpb->sectors_per_cluster;
+    if (volume->clusters > FAT16_MAX_CLUSTERS) {
+        return false;
+    }
+
+    volume->dev = dev;
+    volume->type = volume->clusters <= FAT12_MAX_CLUSTERS ? 12 : 16;
+    volume->sectors_per_cluster = bpb->sectors_per_cluster;
+    volume->fat_start = lba + bpb->reserved_sectors;
+    volume->root_start = volume->fat_start + bpb->fat_count * bpb->fat_sectors;
+    volume->root_entries = bpb->root_entries;
+    volume->data_start = lba + data;
+    return true;
+}
+
+bool fat_mount(struct FatVolume *volume, struct BlockDevice *dev) {
+    if (!cache_read(dev, 0, 1, sector) || get16(&sector[510]) != BOOT_SIGNATURE) {
+        return false;
+    }
+
+    // a floppy, or a disk without partitions
+    if (mount_at(volume, dev, 0)) {
+        return true;
+    }
+
+    struct MbrPartition partitions[4];
+    memcpy(partitions, &sector[MBR_PARTITIONS], sizeof(partitions));
+
+    for (size_t i = 0; i < 4; i++) {
+        switch (partitions[i].type) {
+            case 0x01: // FAT12
+            case 0x04: // FAT16 < 32M
+            case 0x06: // FAT16
+            case 0x0E: // FAT16, LBA
+                if (cache_read(dev, partitions[i].lba, 1, sector)
+                        && mount_at(volume, dev, partitions[i].lba)) {
+                    return true;
+                }
+                break;
+        }
+    }
+
+    return false;
+}
+
+// returns the FAT entry for cluster, 0 on read errors
+static u32 next_cluster(const struct FatVolume *volume, u32 cluster) {
+    // FAT12 entries are 1.5 bytes and may cross into the next sector
+    // keyed on the sectors themselves, a volume struct may be mounted again
+    // on another device
+    static u8 fat[2 * BLOCK_SECTOR_SIZE];
+    static struct BlockDevice *cached_dev = NULL;
+    static u64 cached_lba = 0;
+
+    u32 offset = volume->type == 12 ? cluster + cluster / 2 : cluster * 2;
+    u64 lba = volume->fat_start + offset / BLOCK_SECTOR_SIZE;
+
+    if (cached_dev != volume->dev || cached_lba != lba) {
+        if (!cache_read(volume->dev, lba, 2, fat)) {
+            cached_dev = NULL;
+            return 0;
+        }
+
+        cached_dev = volume->dev;
+        cached_lba = lba;
+    }
+
+    u16 entry = get16(&fat[offset % BLOCK_SECTOR_SIZE]);
+    if (volume->type == 16) {
+        return entry;
+    }
+
+    entry = (cluster & 1) != 0 ? entry >> 4 : entry & 0xFFF;
+    return entry >= 0xFF0 ? entry | 0xF000 : entry;
+}
+
+// resolves the cluster chain starting at cluster into extents, merging
+// clusters that follow each other on disk
+static bool map_chain(struct FatFile *file, u32 cluster) {
+    const struct FatVolume *volume = file->volume;
+    u32 needed = (file->size + volume->sectors_per_cluster * BLOCK_SECTOR_SIZE - 1)
+        / (volume->sectors_per_cluster * BLOCK_SECTOR_SIZE);
+
+    file->extent_count = 0;
+    for (u32 i = 0; i < needed; i++) {
+        // clusters 0 and 1 are reserved, anything above the last is a bad
+        // cluster or the end of the chain
+        if (cluster < 2 || cluster >= volume->clusters + 2) {
+            return false;
+        }
+
+        u64 lba = volume->data_start + (u64) (cluster - 2) * volume->sectors_per_cluster;
+        struct BlockExtent *last = file->extent_count != 0
+            ? &file->extents[file->extent_count - 1] : NULL;
+        if (last != NULL && last->lba + last->count == lba) {
+            last->count += volume->sectors_per_cluster;
+        } else if (file->extent_count < FAT_MAX_EXTENTS) {
+            file->extents[file->extent_count++] = (struct BlockExtent) {
+                .lba = lba,
+                .count = volume->sectors_per_cluster
+            };
+        } else {
+            return false;
+        }
+
+        if (i + 1 < needed) {
+            cluster = next_cluster(volume, cluster);
+        }
+    }
+
+    return true;
+}
+
+// converts a name to the space padded form used in directory entries
+static bool to_83(const char *name, char out[11]) {
+    memset(out, ' ', 11);
+
+    size_t i = 0, max = 8;
+    for (; *name != '\0'; name++) {
+        if (*name == '.' && max == 8) {
+            i = 8;
+            max = 11;
+            continue;
+        }
+
+        if (i >= max) {
+            return false;
+        }
+
+        char c = *name;
+        out[i++] = c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+    }
+
+    return i != 0;
+}
+
+bool fat_open(struct FatVolume *volume, const char *name, struct FatFile *file) {
+    char wanted[11];
+    if (!to_83(name, wanted)) {
+        return false;
+    }
+
+    const struct DirEntry *entries = (const struct DirEntry *) sector;
+    const size_t per_sector = BLOCK_SECTOR_SIZE / ENTRY_SIZE;
+    for (u32 i = 0; i < volume->root_entries; i++) {
+        if (i % per_sector == 0
+                && !cache_read(volume->dev, volume->root_start + i / per_sector, 1, sector)) {
+            return false;
+        }
+
+        const struct DirEntry *entry = &entries[i % per_sector];
+        if ((u8) entry->name[0] == ENTRY_END) {
+            return false;
+        }
+
+        // long names come as entries marked as volume labels, skip them too
+        if ((u8) entry->name[0] == ENTRY_DELETED
+                || (entry->attributes & (ATTR_VOLUME_ID | ATTR_DIRECTORY)) != 0) {
+            continue;
+        }
+
+        size_t j = 0;
+        while (j < 11 && entry->name[j] == wanted[j]) {
+            j++;
+        }
+
+        if (j == 11) {
+            file->volume = volume;
+            file->size = entry->size;
+            return map_chain(file, entry->cluster);
+        }
+    }
+
+    return false;
+}
+
+bool fat_read(const struct FatFile *file, u32 first, size_t count, void *dst) {
+    return cache_read_extents(file->volume->dev, file->extents, file->extent_count, first, count, dst);
+}
@@ -0,0 +1,44 @@
+#ifndef FAT_H
+#define FAT_H
+
+#include "util.h"
+#include "block.h"
+
+// fragments a file may have, more are not opened
+#define FAT_MAX_EXTENTS 32
+
+// a FAT12 or FAT16 filesystem, either on the whole disk or in one of the
+// primary partitions of an MBR
+struct FatVolume {
+    struct BlockDevice *dev;
+    u8 type;
+
+    u32 sectors_per_cluster;
+    u32 clusters;
+
+    // absolute sectors on dev
+    u64 fat_start, root_start, data_start;
+    u32 root_entries;
+};
+
+// a file in the root directory, with its cluster chain resolved into runs of
+// consecutive sectors once when it is opened
+struct FatFile {
+    struct FatVolume *volume;
+    u32 size;
+
+    size_t extent_count;
+    struct BlockExtent extents[FAT_MAX_EXTENTS];
+};
+
+// looks for a filesystem on dev, returns false if there is none
+bool fat_mount(struct FatVolume *volume, struct BlockDevice *dev);
+
+// opens an 8.3 name (e.g. "FRAMES.CLP") in the root directory, case does
+// not matter. returns false if there is no such file
+bool fat_open(struct FatVolume *volume, const char *name, struct FatFile *file);
+
+// reads count sectors starting at sector first of the file
+bool fat_read(const struct FatFile *file, u32 first, size_t count, void *dst);
+
+#endif
@@ -0,0 +1,361 @@
+#include "fdc.h"
+#include "irq.h"
+#include "timer.h"
+
+// SEE: https://wiki.osdev.org/Floppy_Disk_Controller
+#define FDC_DOR  0x3F2
+#define FDC_MSR  0x3F4
+#define FDC_FIFO 0x3F5
+#define FDC_CCR  0x3F7
+#define FDC_IRQ  6
+
+#define DOR_ENABLE   0x04
+#define DOR_DMA      0x08
+#define DOR_MOTOR_A  0x10
+
+#define MSR_DIO 0x40
+#define MSR_RQM 0x80
+
+// 500 kbit/s, for 1.44M disks
+#define CCR_500K 0x00
+
+#define CMD_SPECIFY      0x03
+#define CMD_SENSE_INT    0x08
+#define CMD_RECALIBRATE  0x07
+#define CMD_SEEK         0x0F
+#define CMD_READ_DATA    0x06
+#define CMD_MT           0x80
+#define CMD_MFM          0x40
+
+// step rate 3ms, head unload 240ms, head load 4ms, DMA mode
+#define SPECIFY_SRT_HUT 0xDF
+#define SPECIFY_HLT_ND  0x02
+
+#define ST0_STATUS   0xC0
+#define ST0_SEEK_END 0x20
+
+// 1.44M geometry
+#define CYLINDERS 80
+#define HEADS 2
+#define SECTORS_PER_TRACK 18
+#define SECTORS_PER_CYLINDER (HEADS * SECTORS_PER_TRACK)
+#define SECTOR_SIZE_CODE 2 // 128 << 2 = 512
+#define GAP3 0x1B
+
+// CMOS drive types, drive A in the high nibble of register 0x10
+#define CMOS_ADDRESS 0x70
+#define CMOS_DATA 0x71
+#define CMOS_FLOPPY 0x10
+#define CMOS_FLOPPY_144M 4
+
+// ISA DMA channel 2
+// SEE: https://wiki.osdev.org/ISA_DMA
+#define DMA_MASK       0x0A
+#define DMA_MODE       0x0B
+#define DMA_FLIP_FLOP  0x0C
+#define DMA_ADDRESS_2  0x04
+#define DMA_COUNT_2    0x05
+#define DMA_PAGE_2     0x81
+#define DMA_CHANNEL_2  0x02
+#define DMA_MASK_ON    0x04
+// single transfer, increment, no auto init, device to memory
+#define DMA_MODE_READ  0x46
+
+// ISA DMA can address 16M and no transfer may cross 64K
+#define DMA_LIMIT 0x1000000
+
+#define SPINUP_TICKS (TIMER_TPS * 3 / 10)
+#define MOTOR_OFF_TICKS (TIMER_TPS * 2)
+#define TIMEOUT_TICKS (TIMER_TPS * 2)
+#define FIFO_RETRIES 10000
+
+enum State {
+    IDLE,
+    SPINUP,
+    RECALIBRATE,
+    SEEK,
+    READ
+};
+
+static struct BlockDevice device = {
+    .name = "FD0",
+    .sectors = CYLINDERS * SECTORS_PER_CYLINDER,
+    .max_transfer = SECTORS_PER_CYLINDER
+};
+
+// one cylinder is read at a time, aligned so it never crosses 64K
+static u8 buffer[SECTORS_PER_CYLINDER * BLOCK_SECTOR_SIZE] __attribute__((aligned(0x8000)));
+
+// everything below is only changed with interrupts off, by submit or the
+// IRQ 6 and timer handlers
+static enum State state = IDLE;
+static bool motor = false, spinning = false, calibrated = false, broken = false;
+static u32 cylinder = 0;
+static u64 deadline = 0;
+static volatile bool irq = false;
+
+// requests to read, the head is the one running
+static struct BlockRequest *head = NULL, *tail = NULL;
+
+// sectors of head read so far, and in the running command
+static size_t progress = 0, reading = 0;
+
+static bool write_fifo(u8 value) {
+    for (size_t i = 0; i < FIFO_RETRIES; i++) {
+        if ((inportb(FDC_MSR) & (MSR_RQM | MSR_DIO)) == MSR_RQM) {
+            outportb(FDC_FIFO, value);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool read_fifo(u8 *value) {
+    for (size_t i = 0; i < FIFO_RETRIES; i++) {
+        if ((inportb(FDC_MSR) & (MSR_RQM | MSR_DIO)) == (MSR_RQM | MSR_DIO)) {
+            *value = inportb(FDC_FIFO);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool sense_interrupt(u8 *st0, u8 *pcn) {
+    return write_fifo(CMD_SENSE_INT) && read_fifo(st0) && read_fifo(pcn);
+}
+
+static void set_motor(bool on) {
+    motor = on;
+    outportb(FDC_DOR, DOR_ENABLE | DOR_DMA | (on ? DOR_MOTOR_A : 0));
+}
+
+static void dma_read(size_t size) {
+    u32 addr = (uintptr_t) buffer,
+        count = size - 1;
+
+    outportb(DMA_MASK, DMA_MASK_ON | DMA_CHANNEL_2);
+    outportb(DMA_FLIP_FLOP, 0xFF);
+    outportb(DMA_ADDRESS_2, addr & 0xFF);
+    outportb(DMA_ADDRESS_2, (addr >> 8) & 0xFF);
+    outportb(DMA_PAGE_2, (addr >> 16) & 0xFF);
+    outportb(DMA_FLIP_FLOP, 0xFF);
+    outportb(DMA_COUNT_2, count & 0xFF);
+    outportb(DMA_COUNT_2, (count >> 8) & 0xFF);
+    outportb(DMA_MODE, DMA_MODE_READ);
+    outportb(DMA_MASK, DMA_CHANNEL_2);
+}
+
+static void finish(bool failed) {
+    struct BlockRequest *req = head;
+    head = req->next;
+    if (head == NULL) {
+        tail = NULL;
+    }
+
+    progress = 0;
+    req->failed = failed;
+    req->done = true;
+}
+
+static void fail_all() {
+    while (head != NULL) {
+        finish(true);
+    }
+
+    state = IDLE;
+}
+
+// starts the next step for the head request: spin up, find track 0, seek to
+// its cylinder and read up to the end of it
+static void step() {
+    if (head == NULL) {
+        state = IDLE;
+        deadline = timer_get() + MOTOR_OFF_TICKS;
+        return;
+    }
+
+    if (!spinning) {
+        if (!motor) {
+            set_motor(true);
+        }
+
+        state = SPINUP;
+        deadline = timer_get() + SPINUP_TICKS;
+        return;
+    }
+
+    deadline = timer_get() + TIMEOUT_TICKS;
+
+    bool sent;
+    u32 lba = (u32) head->lba + progress,
+        c = lba / SECTORS_PER_CYLINDER,
+        h = (lba / SECTORS_PER_TRACK) % HEADS,
+        s = lba % SECTORS_PER_TRACK + 1;
+
+    if (!calibrated) {
+        state = RECALIBRATE;
+        sent = write_fifo(CMD_RECALIBRATE) && write_fifo(0);
+    } else if (c != cylinder) {
+        state = SEEK;
+        sent = write_fifo(CMD_SEEK) && write_fifo(h << 2) && write_fifo(c);
+    } else {
+        // multi track, so a read can go on from head 0 to head 1
+        state = READ;
+        reading = MIN(head->count - progress, (size_t) (SECTORS_PER_CYLINDER - lba % SECTORS_PER_CYLINDER));
+        dma_read(reading * BLOCK_SECTOR_SIZE);
+        sent = write_fifo(CMD_MT | CMD_MFM | CMD_READ_DATA)
+            && write_fifo(h << 2)
+            && write_fifo(c)
+            && write_fifo(h)
+            && write_fifo(s)
+            && write_fifo(SECTOR_SIZE_CODE)
+            && write_fifo(SECTORS_PER_TRACK)
+            && write_fifo(GAP3)
+            && write_fifo(0xFF);
+    }
+
+    if (!sent) {
+        broken = true;
+        fail_all();
+    }
+}
+
+static void fdc_irq(struct Registers *regs) {
+    irq = true;
+
+    u8 st0, pcn, result[7];
+    switch (state) {
+    case RECALIBRATE:
+    case SEEK:
+        if (!sense_interrupt(&st0, &pcn) || (st0 & (ST0_STATUS | ST0_SEEK_END)) != ST0_SEEK_END) {
+            calibrated = false;
+            finish(true);
+        } else {
+            calibrated = true;
+            cylinder = pcn;
+        }
+
+        step();
+        break;
+    case READ:
+        for (size_t i = 0; i < sizeof(result); i++) {
+            if (!read_fifo(&result[i])) {
+                broken = true;
+                fail_all();
+                return;
+            }
+        }
+
+        if ((result[0] & ST0_STATUS) != 0) {
+            finish(true);
+        } else {
+            memcpy((u8 *) head->dst + progress * BLOCK_SECTOR_SIZE, buffer, reading * BLOCK_SECTOR_SIZE);
+            progress += reading;
+            if (progress == head->count) {
+                finish(false);
+            }
+        }
+
+        step();
+        break;
+    default:
+        break;
+    }
+}
+
+static void fdc_timer(u64 ticks) {
+    if (ticks < deadline) {
+        return;
+    }
+
+    switch (state) {
+    case IDLE:
+        if (motor) {
+            set_motor(false);
+            spinning = false;
+        }
+        break;
+    case SPINUP:
+        spinning = true;
+        step();
+        break;
+    default:
+        // no interrupt, i.e. no disk in the drive. give up on the drive
+        // instead of resetting the controller in the middle of a command
+        outportb(DMA_MASK, DMA_MASK_ON | DMA_CHANNEL_2);
+        broken = true;
+        fail_all();
+        break;
+    }
+}
+
+static bool fdc_submit(struct BlockDevice *dev, struct BlockRequest *req) {
+    if (broken) {
+        return false;
+    }
+
+    CLI();
+    if (tail == NULL) {
+        head = tail = req;
+        step();
+    } else {
+        tail->next = req;
+        tail = req;
+    }
+    STI();
+
+    return true;
+}
+
+static bool fdc_read(struct BlockDevice *dev, u64 lba, size_t count, void *dst) {
+    struct BlockRequest req = { .lba = lba, .count = count, .dst = dst };
+    if (!block_submit(dev, &req)) {
+        return false;
+    }
+
+    while (!req.done);
+    return !req.failed;
+}
+
+bool fdc_init() {
+    outportb(CMOS_ADDRESS, CMOS_FLOPPY);
+    if ((inportb(CMOS_DATA) >> 4) != CMOS_FLOPPY_144M
+            || (uintptr_t) buffer + sizeof(buffer) > DMA_LIMIT) {
+        return false;
+    }
+
+    irq_install(FDC_IRQ, fdc_irq);
+
+    // reset, the controller interrupts once it is done
+    irq = false;
+    outportb(FDC_DOR, 0);
+    set_motor(false);
+
+    u64 timeout = timer_get() + TIMEOUT_TICKS;
+    while (!irq) {
+        if (timer_get() > timeout) {
+            return false;
+        }
+    }
+
+    // one sense interrupt per drive after a reset
+    u8 st0, pcn;
+    for (size_t i = 0; i < 4; i++) {
+        sense_interrupt(&st0, &pcn);
+    }
+
+    outportb(FDC_CCR, CCR_500K);
+    if (!write_fifo(CMD_SPECIFY)
+            || !write_fifo(SPECIFY_SRT_HUT)
+            || !write_fifo(SPECIFY_HLT_ND)) {
+        return false;
+    }
+
+    device.read = fdc_read;
+    device.submit = fdc_submit;
+    timer_install(fdc_timer);
+    block_register(&device);
+    return true;
+}
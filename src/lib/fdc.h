@@ -0,0 +1,11 @@
+#ifndef FDC_H
+#define FDC_H
+
+#include "util.h"
+#include "block.h"
+
+// resets the floppy controller and registers drive A as block device if the
+// CMOS reports a 1.44M drive. returns false if there is none
+bool fdc_init();
+
+#endif
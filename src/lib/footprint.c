@@ -0,0 +1,78 @@
+#include "footprint.h"
+#include "page.h"
+#include "font.h"
+#include "serial.h"
+
+// from start.S and link.ld, only their addresses mean something
+extern u32 stack_begin[], stack[];
+extern u8 text_size[], rodata_size[], data_size[], bss_size[], end[];
+
+size_t footprint_stack_size() {
+    return (stack - stack_begin) * sizeof(u32);
+}
+
+size_t footprint_stack_used() {
+    // the stack grows down, the first overwritten word is the deepest
+    const u32 *p = stack_begin;
+    while (p < stack && *p == FOOTPRINT_STACK_CANARY) {
+        p++;
+    }
+
+    return (stack - p) * sizeof(u32);
+}
+
+// writes line i of the report to buf, returns false past the last one
+static bool format_line(size_t i, char *buf, size_t n) {
+    char num[32];
+
+    // sections in bytes, where the kernel ends in KiB and free memory in MiB
+    static const char *NAMES[] = {
+        "STKFREE", "TEXT", "RODATA", "DATA", "BSS", "END", "MEMFREE"
+    };
+    static const char *UNITS[] = {
+        "", "", "", "", "", "K", "M"
+    };
+    const size_t values[] = {
+        footprint_stack_size() - footprint_stack_used(),
+        (size_t) text_size, (size_t) rodata_size, (size_t) data_size, (size_t) bss_size,
+        (size_t) end / 1024,
+        page_free_count() / (1024 * 1024 / PAGE_SIZE)
+    };
+
+    if (i >= sizeof(values) / sizeof(values[0])) {
+        return false;
+    }
+
+    strlcpy(buf, NAMES[i], n);
+    while (strlen(buf) < 8) {
+        strlcat(buf, " ", n);
+    }
+
+    itoa((i32) values[i], num, sizeof(num));
+    strlcat(buf, num, n);
+    strlcat(buf, UNITS[i], n);
+    return true;
+}
+
+size_t footprint_draw(size_t x, size_t y, u8 color) {
+    char buf[64];
+    size_t lines = 0;
+
+    for (size_t i = 0; format_line(i, buf, sizeof(buf)); i++) {
+        font_str(buf, x, y, color);
+        y += font_height() + 1;
+        lines++;
+    }
+
+    return lines;
+}
+
+void footprint_dump() {
+    char buf[64];
+
+    serial_write("footprint:\n");
+    for (size_t i = 0; format_line(i, buf, sizeof(buf)); i++) {
+        serial_write(buf);
+        serial_write("\n");
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+#include "util.h"
+
+// must match start.S
+#define FOOTPRINT_STACK_CANARY 0x5AC3A55C
+
+// bytes of the kernel stack that were ever used, found by looking for the
+// deepest word start.S filled with the canary that has been overwritten
+size_t footprint_stack_used();
+size_t footprint_stack_size();
+
+// draws how much of the stack was never touched, the size of each kernel
+// section, where the kernel ends and how much memory the page allocator has
+// left. returns the number of lines drawn
+size_t footprint_draw(size_t x, size_t y, u8 color);
+void footprint_dump();
+
+#endif
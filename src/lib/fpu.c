@@ -1,15 +1,40 @@
 #include "fpu.h"
 
+#define CPUID_FXSR (1 << 24)
+#define CPUID_SSE (1 << 25)
+#define CPUID_SSE2 (1 << 26)
+
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+static bool sse2 = false;
+
 void fpu_init() {
     size_t t;
+    u32 a, b, c, d;
 
     asm("clts");
     asm("mov %%cr0, %0" : "=r"(t));
-    t &= ~(1 << 2);
-    t |= (1 << 1);
+    t &= ~CR0_EM;
+    t |= CR0_MP;
     asm("mov %0, %%cr0" :: "r"(t));
+    asm("fninit");
+
+    // setting the CR4 bits without SSE would fault
+    cpuid(1, &a, &b, &c, &d);
+    if ((d & (CPUID_FXSR | CPUID_SSE)) != (CPUID_FXSR | CPUID_SSE)) {
+        return;
+    }
+
     asm("mov %%cr4, %0" : "=r"(t));
-    t |= 3 << 9;
+    t |= CR4_OSFXSR | CR4_OSXMMEXCPT;
     asm("mov %0, %%cr4" :: "r"(t));
-    asm("fninit");
+
+    sse2 = (d & CPUID_SSE2) != 0;
+}
+
+bool fpu_has_sse2() {
+    return sse2;
 }
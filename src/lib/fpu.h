@@ -3,6 +3,11 @@
 
 #include "util.h"
 
+// enables the x87 FPU, and SSE if the CPU has it. must run before any
+// floating point or SSE code
 void fpu_init();
 
+// true once fpu_init turned on SSE and the CPU also has SSE2
+bool fpu_has_sse2();
+
 #endif
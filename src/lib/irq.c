@@ -32,8 +32,8 @@ static void stub(struct Registers *regs) {
         }
     }
 
-    // send EOI
-    if (regs->int_no >= 0x40) {
+    // send EOI, IRQs 8-15 also need one for the slave PIC
+    if (regs->int_no >= PIC2_OFFSET) {
         outportb(PIC2, PIC_EOI);
     }
 
@@ -56,14 +56,19 @@ static void irq_remap() {
 
 static void irq_set_mask(size_t i) {
     u16 port = i < 8 ? PIC1_DATA : PIC2_DATA;
-    u8 value = inportb(port) | (1 << i);
+    u8 value = inportb(port) | (1 << (i % 8));
     outportb(port, value);
 }
 
 static void irq_clear_mask(size_t i) {
     u16 port = i < 8 ? PIC1_DATA : PIC2_DATA;
-    u8 value = inportb(port) & ~(1 << i);
+    u8 value = inportb(port) & ~(1 << (i % 8));
     outportb(port, value);
+
+    // IRQs 8-15 arrive through the cascade on IRQ 2
+    if (i >= 8) {
+        irq_clear_mask(2);
+    }
 }
 
 void irq_install(size_t i, void (*handler)(struct Registers *)) {
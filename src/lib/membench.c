@@ -0,0 +1,127 @@
+#include "membench.h"
+#include "page.h"
+#include "font.h"
+#include "serial.h"
+
+static struct MemBench results;
+static bool done = false;
+
+// the loops util.h had, kept from being turned back into library calls
+__attribute__((noinline, optimize("no-tree-loop-distribute-patterns")))
+static void memset_bytes(void *dst, u8 value, size_t n) {
+    u8 *d = dst;
+
+    while (n-- > 0) {
+        *d++ = value;
+    }
+}
+
+__attribute__((noinline, optimize("no-tree-loop-distribute-patterns")))
+static void memcpy_bytes(void *dst, const void *src, size_t n) {
+    u8 *d = dst;
+    const u8 *s = src;
+
+    while (n-- > 0) {
+        *d++ = *s++;
+    }
+}
+
+__attribute__((noinline))
+static void memset_words(void *dst, u8 value, size_t n) {
+    memset(dst, value, n);
+}
+
+__attribute__((noinline))
+static void memcpy_words(void *dst, const void *src, size_t n) {
+    memcpy(dst, src, n);
+}
+
+const struct MemBench *membench_run() {
+    u8 *a = page_alloc(PAGES(MEMBENCH_SIZE)),
+        *b = page_alloc(PAGES(MEMBENCH_SIZE));
+    if (a == NULL || b == NULL) {
+        if (a != NULL) {
+            page_free(a, PAGES(MEMBENCH_SIZE));
+        }
+
+        return NULL;
+    }
+
+    // touch both first, so neither side pays for the first cache misses alone
+    memset(a, 0, MEMBENCH_SIZE);
+    memset(b, 0, MEMBENCH_SIZE);
+
+    u64 start = rdtsc();
+    for (size_t i = 0; i < MEMBENCH_RUNS; i++) {
+        memset_bytes(a, (u8) i, MEMBENCH_SIZE);
+    }
+    results.memset_bytes = (rdtsc() - start) / MEMBENCH_RUNS;
+
+    start = rdtsc();
+    for (size_t i = 0; i < MEMBENCH_RUNS; i++) {
+        memset_words(a, (u8) i, MEMBENCH_SIZE);
+    }
+    results.memset_words = (rdtsc() - start) / MEMBENCH_RUNS;
+
+    start = rdtsc();
+    for (size_t i = 0; i < MEMBENCH_RUNS; i++) {
+        memcpy_bytes(b, a, MEMBENCH_SIZE);
+    }
+    results.memcpy_bytes = (rdtsc() - start) / MEMBENCH_RUNS;
+
+    start = rdtsc();
+    for (size_t i = 0; i < MEMBENCH_RUNS; i++) {
+        memcpy_words(b, a, MEMBENCH_SIZE);
+    }
+    results.memcpy_words = (rdtsc() - start) / MEMBENCH_RUNS;
+
+    page_free(a, PAGES(MEMBENCH_SIZE));
+    page_free(b, PAGES(MEMBENCH_SIZE));
+    done = true;
+    return &results;
+}
+
+// writes line i of the results to buf, returns false past the last one
+static bool format_line(size_t i, char *buf, size_t n) {
+    char num[32];
+
+    if (!done || i >= 2) {
+        return false;
+    }
+
+    strlcpy(buf, i == 0 ? "MEMSET " : "MEMCPY ", n);
+    itoa((i32) udiv64(i == 0 ? results.memset_bytes : results.memcpy_bytes, 1000), num, sizeof(num));
+    strlcat(buf, num, n);
+    strlcat(buf, "K > ", n);
+    itoa((i32) udiv64(i == 0 ? results.memset_words : results.memcpy_words, 1000), num, sizeof(num));
+    strlcat(buf, num, n);
+    strlcat(buf, "K", n);
+    return true;
+}
+
+size_t membench_draw(size_t x, size_t y, u8 color) {
+    char buf[64];
+    size_t lines = 0;
+
+    for (size_t i = 0; format_line(i, buf, sizeof(buf)); i++) {
+        font_str(buf, x, y, color);
+        y += font_height() + 1;
+        lines++;
+    }
+
+    return lines;
+}
+
+void membench_dump() {
+    char buf[64];
+
+    if (!done) {
+        return;
+    }
+
+    serial_write("memset/memcpy cycles, byte loop > util.h:\n");
+    for (size_t i = 0; format_line(i, buf, sizeof(buf)); i++) {
+        serial_write(buf);
+        serial_write("\n");
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef MEMBENCH_H
+#define MEMBENCH_H
+
+#include "util.h"
+
+// bytes per run, one screen worth
+#define MEMBENCH_SIZE (320 * 200)
+#define MEMBENCH_RUNS 8
+
+struct MemBench {
+    // average TSC cycles per run with the old byte loops and with util.h
+    u64 memset_bytes, memset_words;
+    u64 memcpy_bytes, memcpy_words;
+};
+
+// times memset and memcpy of MEMBENCH_SIZE bytes in RAM against the byte at
+// a time loops util.h used before. returns NULL without memory to run on
+const struct MemBench *membench_run();
+
+// draws the results as cycles per run, byte loop against util.h. returns the
+// number of lines drawn
+size_t membench_draw(size_t x, size_t y, u8 color);
+void membench_dump();
+
+#endif
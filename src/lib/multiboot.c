@@ -0,0 +1,27 @@
+#include "multiboot.h"
+
+static const struct MultibootInfo *info = NULL;
+
+bool multiboot_init(u32 magic, u32 mbi) {
+    info = magic == MULTIBOOT_LOADER_MAGIC ?
+        (const struct MultibootInfo *) mbi : NULL;
+    return info != NULL;
+}
+
+bool multiboot_booted() {
+    return info != NULL;
+}
+
+const struct MultibootInfo *multiboot_info() {
+    return info;
+}
+
+const struct MultibootModule *multiboot_module(size_t i) {
+    if (info == NULL
+            || !(info->flags & MULTIBOOT_INFO_MODULES)
+            || i >= info->mods_count) {
+        return NULL;
+    }
+
+    return &((const struct MultibootModule *) info->mods_addr)[i];
+}
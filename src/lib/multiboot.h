@@ -0,0 +1,48 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include "util.h"
+
+// SEE: https://www.gnu.org/software/grub/manual/multiboot/multiboot.html
+
+// passed in %eax by a multiboot loader, see start.S
+#define MULTIBOOT_LOADER_MAGIC 0x2BADB002
+
+#define MULTIBOOT_INFO_MEMORY   (1 << 0)
+#define MULTIBOOT_INFO_MODULES  (1 << 3)
+#define MULTIBOOT_INFO_MMAP     (1 << 6)
+
+struct MultibootModule {
+    u32 start, end;
+    u32 string;
+    u32 __reserved;
+} PACKED;
+
+// size does not count itself, entries are size + 4 bytes apart
+struct MultibootMmapEntry {
+    u32 size;
+    u64 base, length;
+    u32 type;
+} PACKED;
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+struct MultibootInfo {
+    u32 flags;
+    u32 mem_lower, mem_upper;
+    u32 boot_device;
+    u32 cmdline;
+    u32 mods_count, mods_addr;
+    u32 syms[4];
+    u32 mmap_length, mmap_addr;
+} PACKED;
+
+// returns true if the kernel was started by a multiboot loader
+bool multiboot_init(u32 magic, u32 info);
+bool multiboot_booted();
+const struct MultibootInfo *multiboot_info();
+
+// returns the i-th boot module, NULL if there is none
+const struct MultibootModule *multiboot_module(size_t i);
+
+#endif
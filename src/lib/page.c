@@ -0,0 +1,147 @@
+#include "page.h"
+#include "bootinfo.h"
+#include "multiboot.h"
+
+#define PAGE_COUNT (PAGE_MEMORY_MAX / PAGE_SIZE)
+#define LOW_MEMORY 0x100000
+
+// without a memory map, assume what every machine that runs this has
+#define FALLBACK_MEMORY (4 * 1024 * 1024)
+
+// end of the kernel, see link.ld
+extern u8 end[];
+
+// one bit per page, set if the page is used
+static u32 bitmap[PAGE_COUNT / 32];
+
+static size_t free_pages = 0, total_pages = 0;
+
+// first page that may be free, allocations search from here
+static size_t hint = 0;
+
+#define used(_i) (bitmap[(_i) / 32] & (1u << ((_i) % 32)))
+
+static void mark(u64 base, u64 length, bool free) {
+    // free only whole pages, reserve every page touched
+    u64 first = free ? (base + PAGE_SIZE - 1) / PAGE_SIZE : base / PAGE_SIZE,
+        last = free ? (base + length) / PAGE_SIZE : (base + length + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    first = MAX(first, (u64) (LOW_MEMORY / PAGE_SIZE));
+    last = MIN(last, (u64) PAGE_COUNT);
+
+    for (size_t i = first; i < last; i++) {
+        if (free && used(i)) {
+            bitmap[i / 32] &= ~(1u << (i % 32));
+            free_pages++;
+        } else if (!free && !used(i)) {
+            bitmap[i / 32] |= 1u << (i % 32);
+            free_pages--;
+        }
+    }
+}
+
+static bool add_bootinfo_map(const struct BootInfo *info) {
+    for (size_t i = 0; i < info->mmap_count; i++) {
+        const struct E820Entry *e = &info->mmap[i];
+
+        // ACPI 3 entries can be marked to be ignored
+        if (e->type == E820_AVAILABLE && (e->acpi & 1)) {
+            mark(e->base, e->length, true);
+        }
+    }
+
+    return info->mmap_count != 0;
+}
+
+static bool add_multiboot_map(const struct MultibootInfo *info) {
+    if (!(info->flags & MULTIBOOT_INFO_MMAP)) {
+        return false;
+    }
+
+    for (uintptr_t p = info->mmap_addr; p < info->mmap_addr + info->mmap_length;) {
+        const struct MultibootMmapEntry *e = (const struct MultibootMmapEntry *) p;
+        if (e->type == MULTIBOOT_MEMORY_AVAILABLE) {
+            mark(e->base, e->length, true);
+        }
+
+        p += e->size + sizeof(e->size);
+    }
+
+    return true;
+}
+
+void page_init() {
+    memset(bitmap, 0xFF, sizeof(bitmap));
+
+    const struct BootInfo *boot = bootinfo_get();
+    const struct MultibootInfo *mb = multiboot_info();
+
+    bool mapped = false;
+    if (boot != NULL) {
+        mapped = add_bootinfo_map(boot);
+    } else if (mb != NULL) {
+        mapped = add_multiboot_map(mb);
+    }
+
+    if (!mapped) {
+        mark(0, FALLBACK_MEMORY, true);
+    }
+
+    // entries may overlap, so count after all of them are in
+    total_pages = free_pages;
+
+    mark(LOW_MEMORY, (uintptr_t) end - LOW_MEMORY, false);
+
+    // the clip and LZ4 staging area are placed past the end of the kernel
+    if (boot != NULL) {
+        for (size_t i = 0; i < boot->image->segment_count; i++) {
+            const struct ImageSegment *s = &boot->image->segments[i];
+            mark(s->addr, s->mem_size, false);
+        }
+    }
+
+    if (mb != NULL && (mb->flags & MULTIBOOT_INFO_MODULES)) {
+        for (size_t i = 0; i < mb->mods_count; i++) {
+            const struct MultibootModule *m = multiboot_module(i);
+            mark(m->start, m->end - m->start, false);
+        }
+    }
+}
+
+void *page_alloc(size_t count) {
+    if (count == 0 || count > free_pages) {
+        return NULL;
+    }
+
+    size_t run = 0;
+    for (size_t i = hint; i < PAGE_COUNT; i++) {
+        run = used(i) ? 0 : run + 1;
+
+        if (run == count) {
+            size_t first = i + 1 - count;
+            mark((u64) first * PAGE_SIZE, (u64) count * PAGE_SIZE, false);
+
+            if (first == hint) {
+                hint = i + 1;
+            }
+
+            return (void *) (first * PAGE_SIZE);
+        }
+    }
+
+    return NULL;
+}
+
+void page_free(void *p, size_t count) {
+    size_t first = (uintptr_t) p / PAGE_SIZE;
+    mark((u64) first * PAGE_SIZE, (u64) count * PAGE_SIZE, true);
+    hint = MIN(hint, first);
+}
+
+size_t page_free_count() {
+    return free_pages;
+}
+
+size_t page_total_count() {
+    return total_pages;
+}
@@ -0,0 +1,24 @@
+#ifndef PAGE_H
+#define PAGE_H
+
+#include "util.h"
+
+#define PAGE_SIZE 4096
+#define PAGES(_n) (((_n) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+// physical memory above this is ignored, keeps the bitmap small
+#define PAGE_MEMORY_MAX (512 * 1024 * 1024)
+
+// builds the free page bitmap from the E820 map of stage0 or the multiboot
+// memory map. memory below 1M, the kernel, the boot image segments and
+// multiboot modules are never handed out.
+void page_init();
+
+// returns count physically contiguous pages, NULL if there are none
+void *page_alloc(size_t count);
+void page_free(void *p, size_t count);
+
+size_t page_free_count();
+size_t page_total_count();
+
+#endif
@@ -0,0 +1,299 @@
+#include "paging.h"
+#include "page.h"
+#include "cache.h"
+#include "isr.h"
+#include "system.h"
+
+#define PAGE_PRESENT (1 << 0)
+#define PAGE_WRITE (1 << 1)
+#define PAGE_PWT (1 << 3)
+#define PAGE_LARGE (1 << 7)
+
+#define LARGE_PAGE_SIZE (4 * 1024 * 1024)
+#define ENTRIES 1024
+
+#define CPUID_PSE (1 << 3)
+#define CPUID_PAT (1 << 16)
+#define CR0_PG (1u << 31)
+#define CR4_PSE (1 << 4)
+
+// PAT entry 1 (selected by PWT alone) is write-through by default, it is
+// changed to write-combining. the others keep their power on types
+#define MSR_PAT 0x277
+#define PAT_WC 0x01
+#define PAT_DEFAULT 0x0007040600070406ull
+#define PAT_WRITE_COMBINING ((PAT_DEFAULT & ~0x0000FF000000FF00ull) \
+    | ((u64) PAT_WC << 8) | ((u64) PAT_WC << 40))
+
+#define PF_PRESENT (1 << 0)
+#define PAGE_FAULT 14
+#define EFLAGS_IF (1 << 9)
+
+#define SECTORS_PER_PAGE (PAGE_SIZE / BLOCK_SECTOR_SIZE)
+
+static u32 *directory = NULL;
+static bool enabled = false, write_combining = false;
+
+// the demand mapped range, with one page table per 4M of it
+static struct {
+    struct BlockDevice *dev;
+    const struct BlockExtent *extents;
+    size_t extent_count;
+    size_t size, pages;
+    u32 *tables;
+
+    // frames the window is made of, and the page each one holds (~0 if none).
+    // replaced in order, oldest first
+    u8 *frames;
+    u32 owner[PAGING_WINDOW_PAGES];
+    size_t next;
+} demand;
+
+static inline u32 read_cr2() {
+    u32 v;
+    asm("mov %%cr2, %0" : "=r"(v));
+    return v;
+}
+
+static inline void invlpg(u32 addr) {
+    asm("invlpg (%0)" :: "r"(addr) : "memory");
+}
+
+static bool has_feature(u32 bit) {
+    u32 a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    return (d & bit) != 0;
+}
+
+static u32 *pte(size_t page) {
+    return &demand.tables[page];
+}
+
+// returns the frame to load into next, unmapping whatever it held
+static u8 *take_frame() {
+    size_t slot = demand.next;
+    demand.next = (demand.next + 1) % PAGING_WINDOW_PAGES;
+
+    if (demand.owner[slot] != ~0u) {
+        *pte(demand.owner[slot]) = 0;
+        invlpg(PAGING_DEMAND_BASE + demand.owner[slot] * PAGE_SIZE);
+    }
+
+    return demand.frames + slot * PAGE_SIZE;
+}
+
+static void map(size_t page, u8 *frame) {
+    demand.owner[(frame - demand.frames) / PAGE_SIZE] = page;
+    *pte(page) = (u32) frame | PAGE_PRESENT | PAGE_WRITE;
+    invlpg(PAGING_DEMAND_BASE + page * PAGE_SIZE);
+}
+
+// reads a page into frame, the part past the end of the data is zeroed
+static bool load(size_t page, u8 *frame) {
+    size_t offset = page * PAGE_SIZE,
+        bytes = MIN(demand.size - offset, (size_t) PAGE_SIZE),
+        sectors = (bytes + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+
+    memset(frame + sectors * BLOCK_SECTOR_SIZE, 0, PAGE_SIZE - sectors * BLOCK_SECTOR_SIZE);
+    return cache_read_extents(demand.dev, demand.extents, demand.extent_count,
+        page * SECTORS_PER_PAGE, sectors, frame);
+}
+
+// returns true if the sectors of a page are in the block cache, and starts
+// reading them if not. pages split across extents are never prefetched
+static bool ready(size_t page) {
+    u64 first = (u64) page * SECTORS_PER_PAGE;
+    for (size_t i = 0; i < demand.extent_count; i++) {
+        const struct BlockExtent *extent = &demand.extents[i];
+        if (first >= extent->count) {
+            first -= extent->count;
+            continue;
+        }
+
+        return extent->count - first >= SECTORS_PER_PAGE
+            && cache_ready(demand.dev, extent->lba + first, SECTORS_PER_PAGE);
+    }
+
+    return false;
+}
+
+// set while a fault is being served with interrupts on
+static bool filling = false;
+
+static void page_fault(struct Registers *regs) {
+    u32 addr = read_cr2();
+    if (demand.tables == NULL || (regs->err_no & PF_PRESENT) != 0
+            || addr < PAGING_DEMAND_BASE || addr - PAGING_DEMAND_BASE >= demand.pages * PAGE_SIZE) {
+        panic("Page fault");
+    }
+
+    // the disk completes reads through its IRQ, so interrupts are on while
+    // the page is filled. that is only safe for faults from code that ran
+    // with interrupts on, i.e. the main loop. IRQ handlers never touch the
+    // demand range, one that does panics here instead of nesting
+    if ((regs->efl & EFLAGS_IF) == 0) {
+        panic("Page fault with interrupts off");
+    }
+
+    if (filling) {
+        panic("Nested demand page fault");
+    }
+
+    filling = true;
+    asm("sti");
+
+    size_t page = (addr - PAGING_DEMAND_BASE) / PAGE_SIZE;
+    u8 *frame = take_frame();
+    if (!load(page, frame)) {
+        panic("DEMAND PAGE READ FAILED");
+    }
+
+    map(page, frame);
+
+    // map the following pages while they are cached anyway, so sequential
+    // reads rarely fault. the others are on their way into the cache
+    for (size_t i = page + 1; i < demand.pages && i <= page + PAGING_PREFETCH_PAGES; i++) {
+        if ((*pte(i) & PAGE_PRESENT) != 0 || !ready(i)) {
+            continue;
+        }
+
+        frame = take_frame();
+        if (!load(i, frame)) {
+            break;
+        }
+
+        map(i, frame);
+    }
+
+    asm("cli");
+    filling = false;
+}
+
+bool paging_init() {
+    if (!has_feature(CPUID_PSE)) {
+        return false;
+    }
+
+    directory = page_alloc(1);
+    if (directory == NULL) {
+        return false;
+    }
+
+    memset(directory, 0, PAGE_SIZE);
+    for (u32 addr = 0; addr < PAGING_IDENTITY_END; addr += LARGE_PAGE_SIZE) {
+        directory[addr / LARGE_PAGE_SIZE] = addr | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE;
+    }
+
+    isr_install(PAGE_FAULT, page_fault);
+
+    u32 t;
+    asm("mov %%cr4, %0" : "=r"(t));
+    t |= CR4_PSE;
+    asm("mov %0, %%cr4" :: "r"(t));
+    asm("mov %0, %%cr3" :: "r"(directory));
+    asm("mov %%cr0, %0" : "=r"(t));
+    t |= CR0_PG;
+    asm("mov %0, %%cr0" :: "r"(t) : "memory");
+
+    enabled = true;
+    return true;
+}
+
+// replaces the 4M page at addr with a table of 4K pages mapping the same
+static u32 *split(u32 addr) {
+    u32 *pde = &directory[addr / LARGE_PAGE_SIZE];
+    if ((*pde & PAGE_LARGE) == 0) {
+        return (u32 *) (*pde & ~(PAGE_SIZE - 1));
+    }
+
+    u32 *table = page_alloc(1);
+    if (table == NULL) {
+        return NULL;
+    }
+
+    u32 base = *pde & ~(LARGE_PAGE_SIZE - 1);
+    for (size_t i = 0; i < ENTRIES; i++) {
+        table[i] = (base + i * PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE;
+    }
+
+    *pde = (u32) table | PAGE_PRESENT | PAGE_WRITE;
+    return table;
+}
+
+bool paging_write_combine(u32 addr, u32 size) {
+    if (!enabled || !has_feature(CPUID_PAT)) {
+        return false;
+    }
+
+    if (!write_combining) {
+        // caches are flushed around changes to the memory types
+        asm("wbinvd");
+        wrmsr(MSR_PAT, PAT_WRITE_COMBINING);
+        write_combining = true;
+    }
+
+    for (u32 p = addr & ~(PAGE_SIZE - 1); p < addr + size; p += PAGE_SIZE) {
+        u32 *table = split(p);
+        if (table == NULL) {
+            return false;
+        }
+
+        table[(p / PAGE_SIZE) % ENTRIES] |= PAGE_PWT;
+    }
+
+    u32 t;
+    asm("mov %%cr3, %0" : "=r"(t));
+    asm("mov %0, %%cr3" :: "r"(t) : "memory");
+    asm("wbinvd");
+    return true;
+}
+
+void *paging_map_demand(struct BlockDevice *dev, const struct BlockExtent *extents, size_t n, size_t size) {
+    if (!enabled || size == 0 || size > PAGING_DEMAND_MAX) {
+        return NULL;
+    }
+
+    // tables for the whole range are allocated once, as is the window
+    if (demand.tables == NULL) {
+        u32 *tables = page_alloc(PAGING_DEMAND_MAX / LARGE_PAGE_SIZE);
+        u8 *frames = page_alloc(PAGING_WINDOW_PAGES);
+        if (tables == NULL || frames == NULL) {
+            if (tables != NULL) {
+                page_free(tables, PAGING_DEMAND_MAX / LARGE_PAGE_SIZE);
+            }
+
+            if (frames != NULL) {
+                page_free(frames, PAGING_WINDOW_PAGES);
+            }
+
+            return NULL;
+        }
+
+        demand.tables = tables;
+        demand.frames = frames;
+
+        for (size_t i = 0; i < PAGING_DEMAND_MAX / LARGE_PAGE_SIZE; i++) {
+            directory[PAGING_DEMAND_BASE / LARGE_PAGE_SIZE + i] =
+                (u32) &demand.tables[i * ENTRIES] | PAGE_PRESENT | PAGE_WRITE;
+        }
+    }
+
+    memset(demand.tables, 0, PAGING_DEMAND_MAX / LARGE_PAGE_SIZE * PAGE_SIZE);
+    for (size_t i = 0; i < PAGING_WINDOW_PAGES; i++) {
+        demand.owner[i] = ~0u;
+    }
+
+    demand.dev = dev;
+    demand.extents = extents;
+    demand.extent_count = n;
+    demand.size = size;
+    demand.pages = PAGES(size);
+    demand.next = 0;
+
+    // drop every stale translation of the range
+    u32 t;
+    asm("mov %%cr3, %0" : "=r"(t));
+    asm("mov %0, %%cr3" :: "r"(t) : "memory");
+
+    return (void *) PAGING_DEMAND_BASE;
+}
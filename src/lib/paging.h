@@ -0,0 +1,36 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "util.h"
+#include "block.h"
+#include "page.h"
+
+// all memory the page allocator hands out stays identity mapped
+#define PAGING_IDENTITY_END PAGE_MEMORY_MAX
+
+// disk backed data is mapped here, pages are read when first touched
+#define PAGING_DEMAND_BASE 0xC0000000
+#define PAGING_DEMAND_MAX (64 * 1024 * 1024)
+
+// pages kept in memory for the demand mapped range, older ones are dropped
+#define PAGING_WINDOW_PAGES 64
+
+// pages after a fault that are mapped right away if the block cache has them
+#define PAGING_PREFETCH_PAGES 4
+
+// turns on paging with the low memory identity mapped in 4M pages. returns
+// false if the CPU has no 4M pages or there is no memory for the tables
+bool paging_init();
+
+// makes the identity mapped range write-combining through the PAT, i.e. for
+// the VGA framebuffer. the MTRRs are left alone: UC there combined with WC in
+// the PAT is WC. returns false without PAT support
+bool paging_write_combine(u32 addr, u32 size);
+
+// maps size bytes spread over n extents of dev at PAGING_DEMAND_BASE. pages
+// are read on the first access and only the last PAGING_WINDOW_PAGES of them
+// stay in memory. extents must stay valid. returns NULL if paging is off or
+// the data is too large, replaces any earlier mapping
+void *paging_map_demand(struct BlockDevice *dev, const struct BlockExtent *extents, size_t n, size_t size);
+
+#endif
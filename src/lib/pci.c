@@ -0,0 +1,105 @@
+#include "pci.h"
+
+// configuration mechanism #1
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+#define PCI_CONFIG_ENABLE  0x80000000
+
+#define PCI_BUSES 256
+#define PCI_SLOTS 32
+#define PCI_FUNCS 8
+
+#define PCI_HEADER_MULTIFUNCTION 0x80
+#define PCI_NO_DEVICE 0xFFFF
+
+static void select(u8 bus, u8 slot, u8 func, u8 offset) {
+    outportl(
+        PCI_CONFIG_ADDRESS,
+        PCI_CONFIG_ENABLE | (bus << 16) | (slot << 11) | (func << 8) | (offset & 0xFC));
+}
+
+u32 pci_read32(const struct PciDevice *dev, u8 offset) {
+    select(dev->bus, dev->slot, dev->func, offset);
+    return inportl(PCI_CONFIG_DATA);
+}
+
+u16 pci_read16(const struct PciDevice *dev, u8 offset) {
+    return (pci_read32(dev, offset) >> ((offset & 2) * 8)) & 0xFFFF;
+}
+
+u8 pci_read8(const struct PciDevice *dev, u8 offset) {
+    return (pci_read32(dev, offset) >> ((offset & 3) * 8)) & 0xFF;
+}
+
+void pci_write32(const struct PciDevice *dev, u8 offset, u32 value) {
+    select(dev->bus, dev->slot, dev->func, offset);
+    outportl(PCI_CONFIG_DATA, value);
+}
+
+// writes only the addressed half, writing back the other one could clear
+// write-1-to-clear bits such as those in the status register
+void pci_write16(const struct PciDevice *dev, u8 offset, u16 value) {
+    select(dev->bus, dev->slot, dev->func, offset);
+    outports(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+u32 pci_bar(const struct PciDevice *dev, size_t i) {
+    return i < 6 ? pci_read32(dev, PCI_BAR0 + i * 4) : 0;
+}
+
+void pci_enable(const struct PciDevice *dev, u16 command) {
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | command);
+}
+
+// calls match for every function present, stops at the n-th one it accepts
+static bool scan(bool (*match)(const struct PciDevice *, u32), u32 arg, size_t n, struct PciDevice *out) {
+    for (size_t bus = 0; bus < PCI_BUSES; bus++) {
+        for (size_t slot = 0; slot < PCI_SLOTS; slot++) {
+            for (size_t func = 0; func < PCI_FUNCS; func++) {
+                struct PciDevice dev = { .bus = bus, .slot = slot, .func = func };
+
+                dev.vendor = pci_read16(&dev, PCI_VENDOR_ID);
+                if (dev.vendor == PCI_NO_DEVICE) {
+                    // function 0 missing means the whole slot is empty
+                    if (func == 0) {
+                        break;
+                    }
+
+                    continue;
+                }
+
+                dev.device = pci_read16(&dev, PCI_DEVICE_ID);
+                dev.class = pci_read8(&dev, PCI_CLASS);
+                dev.subclass = pci_read8(&dev, PCI_SUBCLASS);
+                dev.prog_if = pci_read8(&dev, PCI_PROG_IF);
+
+                if (match(&dev, arg) && n-- == 0) {
+                    *out = dev;
+                    return true;
+                }
+
+                if (func == 0 && !(pci_read8(&dev, PCI_HEADER_TYPE) & PCI_HEADER_MULTIFUNCTION)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool match_class(const struct PciDevice *dev, u32 arg) {
+    return dev->class == (arg >> 8) && dev->subclass == (arg & 0xFF);
+}
+
+static bool match_device(const struct PciDevice *dev, u32 arg) {
+    return dev->vendor == (arg >> 16) && dev->device == (arg & 0xFFFF);
+}
+
+bool pci_find_class(u8 class, u8 subclass, size_t n, struct PciDevice *out) {
+    return scan(match_class, (class << 8) | subclass, n, out);
+}
+
+bool pci_find_device(u16 vendor, u16 device, size_t n, struct PciDevice *out) {
+    return scan(match_device, ((u32) vendor << 16) | device, n, out);
+}
@@ -0,0 +1,49 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "util.h"
+
+// SEE: https://wiki.osdev.org/PCI
+#define PCI_VENDOR_ID   0x00
+#define PCI_DEVICE_ID   0x02
+#define PCI_COMMAND     0x04
+#define PCI_PROG_IF     0x09
+#define PCI_SUBCLASS    0x0A
+#define PCI_CLASS       0x0B
+#define PCI_HEADER_TYPE 0x0E
+#define PCI_BAR0        0x10
+#define PCI_IRQ_LINE    0x3C
+
+#define PCI_COMMAND_IO          (1 << 0)
+#define PCI_COMMAND_MEMORY      (1 << 1)
+#define PCI_COMMAND_BUS_MASTER  (1 << 2)
+
+#define PCI_BAR_IO 0x1
+#define PCI_BAR_IO_MASK 0xFFFFFFFC
+
+struct PciDevice {
+    u8 bus, slot, func;
+    u16 vendor, device;
+    u8 class, subclass, prog_if;
+};
+
+u32 pci_read32(const struct PciDevice *dev, u8 offset);
+u16 pci_read16(const struct PciDevice *dev, u8 offset);
+u8 pci_read8(const struct PciDevice *dev, u8 offset);
+void pci_write32(const struct PciDevice *dev, u8 offset, u32 value);
+void pci_write16(const struct PciDevice *dev, u8 offset, u16 value);
+
+// returns the base address register, 0 if i is out of range
+u32 pci_bar(const struct PciDevice *dev, size_t i);
+
+// sets bits in the command register, i.e. to enable bus mastering
+void pci_enable(const struct PciDevice *dev, u16 command);
+
+// scans every bus for the n-th device of a class and subclass, returns false
+// if there is none
+bool pci_find_class(u8 class, u8 subclass, size_t n, struct PciDevice *out);
+
+// same by vendor and device ID
+bool pci_find_device(u16 vendor, u16 device, size_t n, struct PciDevice *out);
+
+#endif
@@ -1,11 +1,36 @@
 #include "screen.h"
+#include "page.h"
+#include "system.h"
+#include "fpu.h"
+#include "sse.h"
+#include "timer.h"
 
-static u8 *BUFFER = (u8 *) 0xA0000;
+static u8 *BUFFER = (u8 *) SCREEN_FRAMEBUFFER;
 
+#ifndef SCREEN_MODE_X
 // double buffers
-u8 _sbuffers[2][SCREEN_SIZE];
+u8 *_sbuffers[2];
+
+u16 _sdirty_min[SCREEN_HEIGHT], _sdirty_max[SCREEN_HEIGHT];
+
+// set until the screen is known to match the buffers
+static bool invalid = true;
+
+// SSE2 kernels are picked in screen_init if the CPU has them
+static bool sse = false;
+#endif
+
+// buffer or page being drawn to
 u8 _sback = 0;
 
+static void fill_scalar(void *dst, u8 value, size_t n) {
+    memset(dst, value, n);
+}
+
+void (*_sfill)(void *dst, u8 value, size_t n) = fill_scalar;
+
+static struct ScreenStats stats;
+
 #define CURRENT (_sbuffers[_sback])
 #define SWAP() (_sback = 1 - _sback)
 
@@ -15,16 +40,359 @@ u8 _sback = 0;
 #define PALETTE_WRITE 0x3C8
 #define PALETTE_DATA 0x3C9
 
+#define AC_INDEX 0x3C0
+#define AC_WRITE 0x3C0
+#define MISC_WRITE 0x3C2
+#define SEQ_INDEX 0x3C4
+#define SEQ_DATA 0x3C5
+#define GC_INDEX 0x3CE
+#define GC_DATA 0x3CF
+#define CRTC_INDEX 0x3D4
+#define CRTC_DATA 0x3D5
+#define INSTAT_READ 0x3DA
+#define INSTAT_RETRACE 0x08
+
+#define NUM_SEQ_REGS 5
+#define NUM_CRTC_REGS 25
+#define NUM_GC_REGS 9
+#define NUM_AC_REGS 21
+
+// SEE: https://files.osdev.org/mirrors/geezer/osd/graphics/modes.c
+// register values for 320x200, 256 colors (mode 13h)
+static const struct {
+    u8 misc;
+    u8 seq[NUM_SEQ_REGS];
+    u8 crtc[NUM_CRTC_REGS];
+    u8 gc[NUM_GC_REGS];
+    u8 ac[NUM_AC_REGS];
+} MODE_13H = {
+    .misc = 0x63,
+    .seq = { 0x03, 0x01, 0x0F, 0x00, 0x0E },
+    .crtc = {
+        0x5F, 0x4F, 0x50, 0x82, 0x54, 0x80, 0xBF, 0x1F,
+        0x00, 0x41, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x9C, 0x0E, 0x8F, 0x28, 0x40, 0x96, 0xB9, 0xA3,
+        0xFF
+    },
+    .gc = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x05, 0x0F, 0xFF },
+    .ac = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+        0x41, 0x00, 0x0F, 0x00, 0x00
+    }
+};
+
+// ticks to wait for the retrace bit to change, longer than a frame at 20 Hz
+#define RETRACE_TIMEOUT (TIMER_TPS / 20 + 1)
+
+// cleared once the retrace bit did not change in time, there is no point in
+// waiting for it after that
+static bool retrace = true;
+
+// waits until the retrace bit reads set, returns false on timeout
+static bool wait_instat(bool set) {
+    u64 start = timer_get();
+    while (((inportb(INSTAT_READ) & INSTAT_RETRACE) != 0) != set) {
+        if (timer_get() - start > RETRACE_TIMEOUT) {
+            retrace = false;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// waits for the start of the next retrace, returns false on timeout
+static bool next_retrace() {
+    // a retrace already in progress may be almost over, wait for a new one
+    return retrace && wait_instat(false) && wait_instat(true);
+}
+
+void screen_wait_retrace() {
+    u64 start = rdtsc();
+    next_retrace();
+
+    u64 cycles = rdtsc() - start;
+    stats.last_vsync_cycles = cycles;
+    stats.vsync_cycles += cycles;
+}
+
+void screen_measure_refresh() {
+    // whole retraces over a quarter second, from one tick edge to another
+    u64 start = timer_get();
+    while (timer_get() == start);
+
+    u32 retraces = 0;
+    start = timer_get();
+    while (timer_get() - start < TIMER_TPS / 4) {
+        if (!next_retrace()) {
+            return;
+        }
+
+        retraces++;
+    }
+
+    stats.refresh_hz = retraces * 4;
+}
+
+#ifdef SCREEN_MODE_X
+// VRAM offset of each page, in every plane
+static const u16 PAGE_OFFSETS[2] = { 0, SCREEN_PLANE_SIZE };
+
+#define MAP_MASK 0x02
+#define MEMORY_MODE 0x04
+#define CRTC_START_HIGH 0x0C
+#define CRTC_START_LOW 0x0D
+#define CRTC_UNDERLINE 0x14
+#define CRTC_MODE_CONTROL 0x17
+
+#define PAGE(_y) (BUFFER + PAGE_OFFSETS[_sback] + (_y) * SCREEN_PLANE_WIDTH)
+
+// selects the planes the next writes go to, one bit per plane
+static void map_mask(u8 planes) {
+    // VRAM writes must not move across the plane switch
+    asm("" ::: "memory");
+    outportb(SEQ_INDEX, MAP_MASK);
+    outportb(SEQ_DATA, planes);
+    asm("" ::: "memory");
+}
+
+void screen_plot(u8 color, size_t x, size_t y) {
+    map_mask(1 << (x & 3));
+    PAGE(y)[x / 4] = color;
+}
+
+void screen_fill_rect(u8 color, size_t x, size_t y, size_t w, size_t h) {
+    if (w == 0 || h == 0) {
+        return;
+    }
+
+    // each byte covers 4 pixels, one per plane. the partial bytes at both
+    // ends get their own masks, everything between is filled 4 at a time
+    size_t first = x / 4, last = (x + w - 1) / 4;
+    u8 left = (0x0F << (x & 3)) & 0x0F,
+        right = 0x0F >> (3 - ((x + w - 1) & 3));
+
+    if (first == last) {
+        left &= right;
+    }
+
+    map_mask(left);
+    for (size_t yy = y; yy < y + h; yy++) {
+        PAGE(yy)[first] = color;
+    }
+
+    if (first == last) {
+        return;
+    }
+
+    map_mask(right);
+    for (size_t yy = y; yy < y + h; yy++) {
+        PAGE(yy)[last] = color;
+    }
+
+    if (last - first > 1) {
+        map_mask(0x0F);
+        for (size_t yy = y; yy < y + h; yy++) {
+            _sfill(&PAGE(yy)[first + 1], color, last - first - 1);
+        }
+    }
+}
+
 void screen_swap() {
-    memcpy(BUFFER, &CURRENT, SCREEN_SIZE);
+    u16 start = PAGE_OFFSETS[_sback];
+    outportb(CRTC_INDEX, CRTC_START_HIGH);
+    outportb(CRTC_DATA, start >> 8);
+    outportb(CRTC_INDEX, CRTC_START_LOW);
+    outportb(CRTC_DATA, start & 0xFF);
+
+    // the start address is latched at the next vertical retrace, until then
+    // the page that is about to be drawn to is still on screen
+    screen_wait_retrace();
+
+    stats.swaps++;
+    stats.last_bytes = 0;
     SWAP();
 }
 
 void screen_clear(u8 color) {
-    memset(&CURRENT, color, SCREEN_SIZE);
+    map_mask(0x0F);
+    _sfill(PAGE(0), color, SCREEN_PLANE_SIZE);
+}
+
+void screen_invalidate() {
+}
+#else
+static void mark_all() {
+    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
+        _sdirty_min[y] = 0;
+        _sdirty_max[y] = SCREEN_WIDTH - 1;
+    }
+}
+
+static void present(bool vsync) {
+    // what is on screen right now, both buffers match it outside the spans
+    u8 *front = _sbuffers[1 - _sback];
+    u32 bytes = 0;
+
+    // the copy starts while the beam is off screen, so it does not tear
+    if (vsync) {
+        screen_wait_retrace();
+    }
+
+    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
+        if (_sdirty_min[y] > _sdirty_max[y]) {
+            continue;
+        }
+
+        // compared a word at a time, rows are word aligned
+        size_t row = y * SCREEN_WIDTH,
+            first = _sdirty_min[y] / 4,
+            last = _sdirty_max[y] / 4;
+        const u32 *back = (const u32 *) (CURRENT + row),
+            *shown = (const u32 *) (front + row);
+
+        _sdirty_min[y] = SCREEN_WIDTH;
+        _sdirty_max[y] = 0;
+
+        if (!invalid) {
+            while (first <= last && back[first] == shown[first]) {
+                first++;
+            }
+
+            if (first > last) {
+                continue;
+            }
+
+            while (back[last] == shown[last]) {
+                last--;
+            }
+        }
+
+        size_t start = first * 4, end = (last + 1) * 4;
+        if (sse) {
+            // widened to whole SSE blocks, rows are 16 byte aligned
+            start &= ~(size_t) 15;
+            end = (end + 15) & ~(size_t) 15;
+            sse_stream(BUFFER + row + start, CURRENT + row + start, end - start);
+            sse_copy(front + row + start, CURRENT + row + start, end - start);
+        } else {
+            memcpy(BUFFER + row + start, CURRENT + row + start, end - start);
+            memcpy(front + row + start, CURRENT + row + start, end - start);
+        }
+
+        bytes += end - start;
+    }
+
+    invalid = false;
+    stats.swaps++;
+    stats.last_bytes = bytes;
+    stats.total_bytes += bytes;
+    SWAP();
+}
+
+void screen_swap() {
+#ifdef SCREEN_VSYNC
+    present(true);
+#else
+    present(false);
+#endif
+}
+
+void screen_swap_now() {
+    present(false);
+}
+
+void screen_clear(u8 color) {
+    _sfill(CURRENT, color, SCREEN_SIZE);
+    mark_all();
+}
+
+void screen_invalidate() {
+    invalid = true;
+    mark_all();
+}
+
+#endif
+
+const struct ScreenStats *screen_stats() {
+    return &stats;
+}
+
+void screen_set_mode() {
+    outportb(MISC_WRITE, MODE_13H.misc);
+
+    for (u8 i = 0; i < NUM_SEQ_REGS; i++) {
+        outportb(SEQ_INDEX, i);
+        outportb(SEQ_DATA, MODE_13H.seq[i]);
+    }
+
+    // unlock CRTC registers 0-7, keep them unlocked while writing
+    outportb(CRTC_INDEX, 0x03);
+    outportb(CRTC_DATA, inportb(CRTC_DATA) | 0x80);
+    outportb(CRTC_INDEX, 0x11);
+    outportb(CRTC_DATA, inportb(CRTC_DATA) & ~0x80);
+
+    for (u8 i = 0; i < NUM_CRTC_REGS; i++) {
+        u8 v = MODE_13H.crtc[i];
+        if (i == 0x03) {
+            v |= 0x80;
+        } else if (i == 0x11) {
+            v &= ~0x80;
+        }
+
+        outportb(CRTC_INDEX, i);
+        outportb(CRTC_DATA, v);
+    }
+
+    for (u8 i = 0; i < NUM_GC_REGS; i++) {
+        outportb(GC_INDEX, i);
+        outportb(GC_DATA, MODE_13H.gc[i]);
+    }
+
+    // reading INSTAT resets the AC index/data flip-flop
+    for (u8 i = 0; i < NUM_AC_REGS; i++) {
+        inportb(INSTAT_READ);
+        outportb(AC_INDEX, i);
+        outportb(AC_WRITE, MODE_13H.ac[i]);
+    }
+
+    // lock the palette and unblank the display
+    inportb(INSTAT_READ);
+    outportb(AC_INDEX, 0x20);
 }
 
 void screen_init() {
+    if (fpu_has_sse2()) {
+        _sfill = sse_fill;
+    }
+
+#ifdef SCREEN_MODE_X
+    // unchain the planes: every plane is addressed linearly, and the CRTC
+    // reads them a byte at a time instead of a dword
+    outportb(SEQ_INDEX, MEMORY_MODE);
+    outportb(SEQ_DATA, 0x06);
+    outportb(CRTC_INDEX, CRTC_UNDERLINE);
+    outportb(CRTC_DATA, 0x00);
+    outportb(CRTC_INDEX, CRTC_MODE_CONTROL);
+    outportb(CRTC_DATA, 0xE3);
+
+    // clear both pages, page 0 is shown and page 1 drawn to first
+    map_mask(0x0F);
+    memset(BUFFER, 0, 2 * SCREEN_PLANE_SIZE);
+    _sback = 1;
+#else
+    sse = fpu_has_sse2();
+    for (size_t i = 0; i < 2; i++) {
+        _sbuffers[i] = page_alloc(PAGES(SCREEN_SIZE));
+        assert(_sbuffers[i] != NULL, "NO MEMORY FOR SCREEN");
+        memset(_sbuffers[i], 0, SCREEN_SIZE);
+    }
+
+    // the first swap writes everything
+    screen_invalidate();
+#endif
+
     // configure palette with 8-bit RRRGGGBB color
     outportb(PALETTE_MASK, 0xFF);
     outportb(PALETTE_WRITE, 0);
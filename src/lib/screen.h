@@ -6,6 +6,7 @@
 #define SCREEN_WIDTH 320
 #define SCREEN_HEIGHT 200
 #define SCREEN_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT)
+#define SCREEN_FRAMEBUFFER 0xA0000
 
 #define COLOR(_r, _g, _b)((u8)( \
     (((_r) & 0x7) << 5) |       \
@@ -25,14 +26,61 @@
             CLAMP(COLOR_B(_c) + __d, 0, 3)      \
         );})
 
-extern u8 _sbuffers[2][SCREEN_SIZE];
+// SCREEN_MODE_X (set by the Makefile with SCREEN_MODE_X=1) draws straight
+// into one of two pages in video memory and flips between them, instead of
+// into back buffers in RAM that are copied to the screen
+
+// without mode X, wait for the vertical retrace before presenting. mode X
+// always does, the new page is only shown from there
+#define SCREEN_VSYNC
+
+// memset for the back buffers, SSE2 if available
+extern void (*_sfill)(void *dst, u8 value, size_t n);
+
+// back buffer or page being drawn to
 extern u8 _sback;
 
+#ifdef SCREEN_MODE_X
+// each of the 4 planes holds every 4th pixel of a page
+#define SCREEN_PLANE_WIDTH (SCREEN_WIDTH / 4)
+#define SCREEN_PLANE_SIZE (SCREEN_SIZE / 4)
+
+// one pixel needs a plane switch, keep these for text and the like
+void screen_plot(u8 color, size_t x, size_t y);
+void screen_fill_rect(u8 color, size_t x, size_t y, size_t w, size_t h);
+
+#define screen_set(_p, _x, _y) screen_plot((_p), (_x), (_y))
+#define screen_fill(_c, _x, _y, _w, _h) screen_fill_rect((_c), (_x), (_y), (_w), (_h))
+#else
+// back buffers, allocated from free pages in screen_init
+extern u8 *_sbuffers[2];
+
+// changed columns of each row in the back buffer, min > max if none.
+// screen_swap only looks at these
+extern u16 _sdirty_min[SCREEN_HEIGHT], _sdirty_max[SCREEN_HEIGHT];
+
 #define screen_buffer() (_sbuffers[_sback])
 
-#define screen_set(_p, _x, _y)\
-    (_sbuffers[_sback][((_y) * SCREEN_WIDTH + (_x))]=(_p))
+// screen_swap without waiting for the vertical retrace, for timing the copy
+// into video memory alone
+void screen_swap_now();
+
+// marks columns _x0 to _x1 (inclusive) of row _y as changed
+#define screen_mark(_x0, _x1, _y) do {\
+        __typeof__(_y) __my = (_y);\
+        u16 __x0 = (_x0), __x1 = (_x1);\
+        if (__x0 < _sdirty_min[__my]) _sdirty_min[__my] = __x0;\
+        if (__x1 > _sdirty_max[__my]) _sdirty_max[__my] = __x1;\
+    } while (0)
+
+#define screen_set(_p, _x, _y) do {\
+        __typeof__(_x) __sx = (_x);\
+        __typeof__(_y) __sy = (_y);\
+        _sbuffers[_sback][__sy * SCREEN_WIDTH + __sx] = (_p);\
+        screen_mark(__sx, __sx, __sy);\
+    } while (0)
 
+// raw access, writes through it must be marked with screen_mark
 #define screen_offset(_x, _y) (screen_buffer()[(_y) * SCREEN_WIDTH + (_x)])
 
 #define screen_fill(_c, _x, _y, _w, _h) do {\
@@ -42,12 +90,54 @@ extern u8 _sback;
         __typeof__(_y) __ymax = __y + (_h);\
         __typeof__(_c) __c = (_c);\
         for (; __y < __ymax; __y++) {\
-            memset(&screen_buffer()[__y * SCREEN_WIDTH + __x], __c, __w);\
+            _sfill(&screen_buffer()[__y * SCREEN_WIDTH + __x], __c, __w);\
+            if (__w != 0) screen_mark(__x, __x + __w - 1, __y);\
         }\
     } while (0)
 
+#endif
+
+struct ScreenStats {
+    u32 swaps;
+
+    // bytes written to video memory by the last swap, and by all of them
+    u32 last_bytes;
+    u64 total_bytes;
+
+    // TSC cycles spent waiting for the vertical retrace, in the last swap
+    // and in all of them
+    u64 last_vsync_cycles, vsync_cycles;
+
+    // retraces per second, 0 until screen_measure_refresh or if the retrace
+    // bit never changes
+    u32 refresh_hz;
+};
+
+// presents the back buffer. only the parts of the marked spans that differ
+// from what is on screen are written to video memory, and the other buffer
+// is kept equal to the screen, so drawing continues on the presented frame.
+// in mode X, this shows the page drawn to and waits until it is on screen,
+// drawing continues on the other page
 void screen_swap();
 void screen_clear(u8 color);
+
+// waits for the start of the next vertical retrace, the time it takes is
+// added to the stats. needs the timer, gives up for good if the retrace bit
+// does not change for a few ticks
+void screen_wait_retrace();
+
+// counts the retraces over a quarter second, needs the timer. blocks for
+// that long, so it is not run at boot
+void screen_measure_refresh();
+
+// makes the next screen_swap write the whole back buffer, unconditionally.
+// nothing to do in mode X
+void screen_invalidate();
+
+const struct ScreenStats *screen_stats();
+
+// switches the VGA to mode 13h without the BIOS (i.e. when booted through multiboot)
+void screen_set_mode();
 void screen_init();
 
 #endif
@@ -0,0 +1,62 @@
+#include "serial.h"
+
+// SEE: https://wiki.osdev.org/Serial_Ports
+#define COM1 0x3F8
+
+#define UART_DATA       (COM1 + 0)
+#define UART_IER        (COM1 + 1)
+#define UART_DIVISOR_LO (COM1 + 0)
+#define UART_DIVISOR_HI (COM1 + 1)
+#define UART_FCR        (COM1 + 2)
+#define UART_LCR        (COM1 + 3)
+#define UART_MCR        (COM1 + 4)
+#define UART_LSR        (COM1 + 5)
+
+#define LCR_8N1         0x03
+#define LCR_DLAB        0x80
+#define MCR_LOOPBACK    0x1E
+#define MCR_NORMAL      0x0F
+#define LSR_THR_EMPTY   0x20
+
+static bool present = false;
+
+void serial_init() {
+    outportb(UART_IER, 0x00);
+
+    // 115200 / 1 baud
+    outportb(UART_LCR, LCR_DLAB);
+    outportb(UART_DIVISOR_LO, 0x01);
+    outportb(UART_DIVISOR_HI, 0x00);
+    outportb(UART_LCR, LCR_8N1);
+
+    // enable and clear FIFOs, 14 byte threshold
+    outportb(UART_FCR, 0xC7);
+
+    // check that there is a UART by sending a byte through loopback
+    outportb(UART_MCR, MCR_LOOPBACK);
+    outportb(UART_DATA, 0xAE);
+    present = inportb(UART_DATA) == 0xAE;
+
+    outportb(UART_MCR, MCR_NORMAL);
+}
+
+bool serial_present() {
+    return present;
+}
+
+void serial_write(const char *s) {
+    if (!present) {
+        return;
+    }
+
+    char c;
+    while ((c = *s++) != 0) {
+        if (c == '\n') {
+            while (!(inportb(UART_LSR) & LSR_THR_EMPTY));
+            outportb(UART_DATA, '\r');
+        }
+
+        while (!(inportb(UART_LSR) & LSR_THR_EMPTY));
+        outportb(UART_DATA, c);
+    }
+}
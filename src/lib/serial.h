@@ -0,0 +1,11 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "util.h"
+
+// COM1, 115200 baud 8N1. output is dropped if no UART is found
+void serial_init();
+bool serial_present();
+void serial_write(const char *s);
+
+#endif
@@ -0,0 +1,79 @@
+#include "sse.h"
+
+#define SSE_ALIGN 16
+
+// xmm0 can only be listed as clobbered when the compiler uses SSE itself,
+// which is also the only case where it could be holding a value there
+#ifdef __SSE__
+#define XMM0_CLOBBER "xmm0",
+#else
+#define XMM0_CLOBBER
+#endif
+
+void sse_fill(void *dst, u8 value, size_t n) {
+    u8 *d = dst;
+
+    // the unaligned head and tail are left to memset
+    size_t head = (SSE_ALIGN - ((uintptr_t) d & (SSE_ALIGN - 1))) & (SSE_ALIGN - 1);
+    if (n < head + SSE_ALIGN) {
+        memset(d, value, n);
+        return;
+    }
+
+    memset(d, value, head);
+    d += head;
+    n -= head;
+
+    size_t blocks = n / SSE_ALIGN;
+    asm(
+        "movd %2, %%xmm0\n\t"
+        "pshufd $0, %%xmm0, %%xmm0\n"
+        "1:\n\t"
+        "movdqa %%xmm0, (%0)\n\t"
+        "add $16, %0\n\t"
+        "dec %1\n\t"
+        "jnz 1b"
+        : "+r" (d), "+r" (blocks)
+        : "r" (value * 0x01010101u)
+        : XMM0_CLOBBER "memory", "cc");
+
+    memset(d, value, n % SSE_ALIGN);
+}
+
+void sse_copy(void *dst, const void *src, size_t n) {
+    size_t blocks = n / SSE_ALIGN;
+    if (blocks == 0) {
+        return;
+    }
+
+    asm(
+        "1:\n\t"
+        "movdqa (%1), %%xmm0\n\t"
+        "movdqa %%xmm0, (%0)\n\t"
+        "add $16, %0\n\t"
+        "add $16, %1\n\t"
+        "dec %2\n\t"
+        "jnz 1b"
+        : "+r" (dst), "+r" (src), "+r" (blocks)
+        :: XMM0_CLOBBER "memory", "cc");
+}
+
+void sse_stream(void *dst, const void *src, size_t n) {
+    size_t blocks = n / SSE_ALIGN;
+    if (blocks == 0) {
+        return;
+    }
+
+    // the stores are weakly ordered, sfence makes them visible before return
+    asm(
+        "1:\n\t"
+        "movdqa (%1), %%xmm0\n\t"
+        "movntdq %%xmm0, (%0)\n\t"
+        "add $16, %0\n\t"
+        "add $16, %1\n\t"
+        "dec %2\n\t"
+        "jnz 1b\n\t"
+        "sfence"
+        : "+r" (dst), "+r" (src), "+r" (blocks)
+        :: XMM0_CLOBBER "memory", "cc");
+}
@@ -0,0 +1,20 @@
+#ifndef SSE_H
+#define SSE_H
+
+#include "util.h"
+
+// SSE2 versions of memset and memcpy for screen sized buffers, only to be
+// called if fpu_has_sse2(). the x87 and SSE state is not saved on
+// interrupts, so none of this may run in an interrupt handler
+
+// like memset, any alignment and length
+void sse_fill(void *dst, u8 value, size_t n);
+
+// copies n bytes, dst, src and n must be multiples of 16
+void sse_copy(void *dst, const void *src, size_t n);
+
+// like sse_copy, but stores around the caches with movntdq. for video
+// memory, which is never read back
+void sse_stream(void *dst, const void *src, size_t n);
+
+#endif
@@ -29,12 +29,27 @@ static void timer_set(int hz) {
     outportb(PIT_A, (d >> 8) & PIT_MASK);
 }
 
+static void (*handlers[TIMER_MAX_HANDLERS])(u64 ticks) = { 0 };
+
 u64 timer_get() {
     return state.ticks;
 }
 
+void timer_install(void (*handler)(u64 ticks)) {
+    for (size_t i = 0; i < TIMER_MAX_HANDLERS; i++) {
+        if (handlers[i] == NULL) {
+            handlers[i] = handler;
+            return;
+        }
+    }
+}
+
 static void timer_handler(struct Registers *regs) {
     state.ticks++;
+
+    for (size_t i = 0; i < TIMER_MAX_HANDLERS && handlers[i] != NULL; i++) {
+        handlers[i](state.ticks);
+    }
 }
 
 void timer_init() {
@@ -6,7 +6,12 @@
 // number chosen to be integer divisor of PIC frequency
 #define TIMER_TPS 363
 
+#define TIMER_MAX_HANDLERS 4
+
 u64 timer_get();
 void timer_init();
 
+// calls handler with the tick count on every tick, from the interrupt
+void timer_install(void (*handler)(u64 ticks));
+
 #endif
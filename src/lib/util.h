@@ -84,6 +84,43 @@ static inline void outportb(u16 port, u8 data) {
     asm("outb %1, %0" : : "dN" (port), "a" (data));
 }
 
+static inline u32 inportl(u16 port) {
+    u32 r;
+    asm("inl %1, %0" : "=a" (r) : "dN" (port));
+    return r;
+}
+
+static inline void outportl(u16 port, u32 data) {
+    asm("outl %1, %0" : : "dN" (port), "a" (data));
+}
+
+static inline u64 rdtsc() {
+    u32 lo, hi;
+    asm("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((u64) hi << 32) | lo;
+}
+
+static inline void cpuid(u32 leaf, u32 *a, u32 *b, u32 *c, u32 *d) {
+    asm("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d) : "a" (leaf), "c" (0));
+}
+
+static inline u64 rdmsr(u32 msr) {
+    u32 lo, hi;
+    asm("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return ((u64) hi << 32) | lo;
+}
+
+static inline void wrmsr(u32 msr, u64 v) {
+    asm("wrmsr" :: "c" (msr), "a" ((u32) v), "d" ((u32) (v >> 32)));
+}
+
+// 64-by-32 bit unsigned division, avoids pulling in libgcc's __udivdi3
+static inline u64 udiv64(u64 n, u32 d) {
+    u32 hi = (u32) (n >> 32), lo = (u32) n, q_lo, r = hi % d;
+    asm("divl %4" : "=a" (q_lo), "=d" (r) : "a" (lo), "d" (r), "rm" (d));
+    return ((u64) (hi / d) << 32) | q_lo;
+}
+
 static inline size_t strlen(const char *str) {
     size_t l = 0;
     while (*str++ != 0) {
@@ -120,10 +157,22 @@ static inline char *itoa(i32 x, char *s, size_t sz) {
     return s;
 }
 
+// the string functions below store whole words with rep stosl/movsl, after
+// lining up the destination byte by byte. they rely on the direction flag
+// being clear, as the ABI requires
+
 static inline void memset(void *dst, u8 value, size_t n) {
     u8 *d = dst;
 
-    while (n-- > 0) {
+    while (n > 0 && ((uintptr_t) d & 3) != 0) {
+        *d++ = value;
+        n--;
+    }
+
+    size_t words = n / 4;
+    asm("rep stosl" : "+D" (d), "+c" (words) : "a" (value * 0x01010101u) : "memory");
+
+    for (n &= 3; n > 0; n--) {
         *d++ = value;
     }
 }
@@ -132,24 +181,37 @@ static inline void *memcpy(void *dst, const void *src, size_t n) {
     u8 *d = dst;
     const u8 *s = src;
 
-    while (n-- > 0) {
+    while (n > 0 && ((uintptr_t) d & 3) != 0) {
         *d++ = *s++;
+        n--;
     }
 
-    return d;
+    size_t words = n / 4, bytes = n & 3;
+    asm("rep movsl" : "+D" (d), "+S" (s), "+c" (words) :: "memory");
+    asm("rep movsb" : "+D" (d), "+S" (s), "+c" (bytes) :: "memory");
+    return dst;
 }
 
 static inline void *memmove(void *dst, const void *src, size_t n) {
     // OK since we know that memcpy copies forwards
-    if (dst < src) {
+    if (dst <= src) {
         return memcpy(dst, src, n);
     }
 
-    u8 *d = dst;
-    const u8 *s = src;
+    // overlapping with dst above src, so copy backwards: the odd bytes at the
+    // end first, then the words
+    u8 *d = (u8 *) dst + n;
+    const u8 *s = (const u8 *) src + n;
+
+    for (size_t i = n & 3; i > 0; i--) {
+        *--d = *--s;
+    }
 
-    for (size_t i = n; i > 0; i--) {
-        d[i - 1] = s[i - 1];
+    size_t words = n / 4;
+    if (words != 0) {
+        d -= 4;
+        s -= 4;
+        asm("std\n\trep movsl\n\tcld" : "+D" (d), "+S" (s), "+c" (words) :: "memory", "cc");
     }
 
     return dst;
@@ -0,0 +1,320 @@
+#include "virtio.h"
+#include "irq.h"
+#include "page.h"
+#include "pci.h"
+
+// SEE: https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.html
+// legacy interface, section 4.1.4.8 and the virtqueue layout in 2.6.2
+#define VIRTIO_VENDOR 0x1AF4
+#define VIRTIO_DEVICE_BLK 0x1001
+
+#define VIRTIO_MAX_DEVICES 2
+
+// I/O registers, relative to BAR0
+#define REG_DEVICE_FEATURES 0x00
+#define REG_GUEST_FEATURES  0x04
+#define REG_QUEUE_ADDRESS   0x08
+#define REG_QUEUE_SIZE      0x0C
+#define REG_QUEUE_SELECT    0x0E
+#define REG_QUEUE_NOTIFY    0x10
+#define REG_STATUS          0x12
+#define REG_ISR             0x13
+#define REG_CONFIG          0x14
+
+// block device configuration, relative to REG_CONFIG
+#define BLK_CAPACITY 0x00
+#define BLK_SEG_MAX  0x0C
+
+#define STATUS_ACKNOWLEDGE 0x01
+#define STATUS_DRIVER      0x02
+#define STATUS_DRIVER_OK   0x04
+#define STATUS_FAILED      0x80
+
+#define BLK_F_SEG_MAX (1 << 2)
+
+#define BLK_T_IN 0
+#define BLK_S_OK 0
+
+#define DESC_F_NEXT  1
+#define DESC_F_WRITE 2
+
+#define QUEUE_ALIGN 4096
+#define QUEUE_MAX 1024
+
+// most sectors per request. the data is split into one descriptor per page.
+// addresses are handed to the device as they are, so buffers, like the
+// queue itself, must be identity mapped
+#define MAX_TRANSFER 256
+#define MAX_SEGMENTS (MAX_TRANSFER * BLOCK_SECTOR_SIZE / PAGE_SIZE + 1)
+
+#define barrier() asm ("" : : : "memory")
+
+struct VirtqDesc {
+    u64 addr;
+    u32 len;
+    u16 flags;
+    u16 next;
+} PACKED;
+
+struct VirtqAvail {
+    u16 flags;
+    u16 idx;
+    u16 ring[];
+} PACKED;
+
+struct VirtqUsedElem {
+    u32 id;
+    u32 len;
+} PACKED;
+
+struct VirtqUsed {
+    u16 flags;
+    u16 idx;
+    struct VirtqUsedElem ring[];
+} PACKED;
+
+struct BlkHeader {
+    u32 type;
+    u32 __reserved;
+    u64 sector;
+} PACKED;
+
+struct VirtioBlk {
+    struct BlockDevice dev;
+    u16 io;
+    u8 irq;
+
+    u16 size;
+    volatile struct VirtqDesc *desc;
+    volatile struct VirtqAvail *avail;
+    volatile struct VirtqUsed *used;
+
+    // free descriptors are chained through next
+    u16 free, free_count, last_used;
+
+    // per request, indexed by its first descriptor
+    struct BlkHeader *headers;
+    volatile u8 *statuses;
+    struct BlockRequest **requests;
+};
+
+static struct VirtioBlk devices[VIRTIO_MAX_DEVICES];
+static size_t device_count = 0;
+
+static const char *NAMES[VIRTIO_MAX_DEVICES] = { "VIRTIO0", "VIRTIO1" };
+
+static u16 alloc_desc(struct VirtioBlk *blk) {
+    u16 i = blk->free;
+    blk->free = blk->desc[i].next;
+    blk->free_count--;
+    return i;
+}
+
+static void free_chain(struct VirtioBlk *blk, u16 i) {
+    for (;;) {
+        u16 flags = blk->desc[i].flags, next = blk->desc[i].next;
+
+        blk->desc[i].next = blk->free;
+        blk->free = i;
+        blk->free_count++;
+
+        if (!(flags & DESC_F_NEXT)) {
+            break;
+        }
+
+        i = next;
+    }
+}
+
+static void virtio_irq(struct Registers *regs) {
+    for (size_t d = 0; d < device_count; d++) {
+        struct VirtioBlk *blk = &devices[d];
+        if (blk->irq != regs->int_no - 32) {
+            continue;
+        }
+
+        // reading the ISR status acknowledges the interrupt
+        inportb(blk->io + REG_ISR);
+
+        while (blk->last_used != blk->used->idx) {
+            barrier();
+            u16 id = blk->used->ring[blk->last_used % blk->size].id;
+            blk->last_used++;
+
+            struct BlockRequest *req = blk->requests[id];
+            blk->requests[id] = NULL;
+            free_chain(blk, id);
+
+            if (req != NULL) {
+                req->failed = blk->statuses[id] != BLK_S_OK;
+                req->done = true;
+            }
+        }
+    }
+}
+
+static bool virtio_submit(struct BlockDevice *dev, struct BlockRequest *req) {
+    struct VirtioBlk *blk = (struct VirtioBlk *) dev;
+
+    // header, one descriptor per page of data and the status byte
+    uintptr_t data = (uintptr_t) req->dst,
+        end = data + req->count * BLOCK_SECTOR_SIZE;
+    size_t segments = (end - 1) / PAGE_SIZE - data / PAGE_SIZE + 1;
+
+    CLI();
+    if (blk->free_count < segments + 2) {
+        STI();
+        return false;
+    }
+
+    u16 head = alloc_desc(blk), prev = head;
+    blk->headers[head] = (struct BlkHeader) {
+        .type = BLK_T_IN,
+        .sector = req->lba
+    };
+    blk->desc[head].addr = (uintptr_t) &blk->headers[head];
+    blk->desc[head].len = sizeof(struct BlkHeader);
+    blk->desc[head].flags = DESC_F_NEXT;
+
+    while (data < end) {
+        uintptr_t next = MIN((data / PAGE_SIZE + 1) * PAGE_SIZE, end);
+        u16 i = alloc_desc(blk);
+        blk->desc[i].addr = data;
+        blk->desc[i].len = next - data;
+        blk->desc[i].flags = DESC_F_WRITE | DESC_F_NEXT;
+        blk->desc[prev].next = i;
+        prev = i;
+        data = next;
+    }
+
+    u16 status = alloc_desc(blk);
+    blk->statuses[head] = 0xFF;
+    blk->desc[status].addr = (uintptr_t) &blk->statuses[head];
+    blk->desc[status].len = 1;
+    blk->desc[status].flags = DESC_F_WRITE;
+    blk->desc[prev].next = status;
+
+    blk->requests[head] = req;
+
+    // the descriptors must be visible before the index that publishes them
+    blk->avail->ring[blk->avail->idx % blk->size] = head;
+    barrier();
+    blk->avail->idx++;
+    barrier();
+    outports(blk->io + REG_QUEUE_NOTIFY, 0);
+    STI();
+
+    return true;
+}
+
+static bool virtio_read(struct BlockDevice *dev, u64 lba, size_t count, void *dst) {
+    struct BlockRequest req = { .lba = lba, .count = count, .dst = dst };
+    if (!block_submit(dev, &req)) {
+        return false;
+    }
+
+    while (!req.done);
+    return !req.failed;
+}
+
+static bool setup(struct VirtioBlk *blk, const struct PciDevice *pci) {
+    u32 bar = pci_bar(pci, 0);
+    if (!(bar & PCI_BAR_IO)) {
+        return false;
+    }
+
+    blk->io = bar & PCI_BAR_IO_MASK;
+    blk->irq = pci_read8(pci, PCI_IRQ_LINE);
+    pci_enable(pci, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+
+    // reset, then announce the driver
+    outportb(blk->io + REG_STATUS, 0);
+    outportb(blk->io + REG_STATUS, STATUS_ACKNOWLEDGE);
+    outportb(blk->io + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+
+    // nothing beyond the segment limit is needed
+    u32 features = inportl(blk->io + REG_DEVICE_FEATURES) & BLK_F_SEG_MAX;
+    outportl(blk->io + REG_GUEST_FEATURES, features);
+
+    outports(blk->io + REG_QUEUE_SELECT, 0);
+    blk->size = inports(blk->io + REG_QUEUE_SIZE);
+    if (blk->size == 0 || blk->size > QUEUE_MAX) {
+        outportb(blk->io + REG_STATUS, STATUS_FAILED);
+        return false;
+    }
+
+    // descriptors and available ring, then the used ring on its own page
+    size_t used_offset = (blk->size * sizeof(struct VirtqDesc)
+            + sizeof(struct VirtqAvail) + (blk->size + 1) * sizeof(u16)
+            + QUEUE_ALIGN - 1) & ~(QUEUE_ALIGN - 1),
+        used_size = sizeof(struct VirtqUsed) + blk->size * sizeof(struct VirtqUsedElem) + sizeof(u16),
+        bookkeeping = blk->size * (sizeof(struct BlkHeader) + sizeof(u8) + sizeof(struct BlockRequest *)),
+        pages = PAGES(used_offset + used_size) + PAGES(bookkeeping);
+
+    u8 *queue = page_alloc(pages);
+    if (queue == NULL) {
+        outportb(blk->io + REG_STATUS, STATUS_FAILED);
+        return false;
+    }
+
+    memset(queue, 0, pages * PAGE_SIZE);
+    blk->desc = (volatile struct VirtqDesc *) queue;
+    blk->avail = (volatile struct VirtqAvail *) (queue + blk->size * sizeof(struct VirtqDesc));
+    blk->used = (volatile struct VirtqUsed *) (queue + used_offset);
+
+    u8 *p = queue + PAGES(used_offset + used_size) * PAGE_SIZE;
+    blk->headers = (struct BlkHeader *) p;
+    blk->requests = (struct BlockRequest **) (p + blk->size * sizeof(struct BlkHeader));
+    blk->statuses = (volatile u8 *) (blk->requests + blk->size);
+
+    for (u16 i = 0; i < blk->size; i++) {
+        blk->desc[i].next = i + 1;
+    }
+    blk->free = 0;
+    blk->free_count = blk->size;
+    blk->last_used = 0;
+
+    // legacy devices take the page number of the queue
+    outportl(blk->io + REG_QUEUE_ADDRESS, (uintptr_t) queue / QUEUE_ALIGN);
+
+    size_t max_transfer = MAX_TRANSFER;
+    if (features & BLK_F_SEG_MAX) {
+        // segments are pages, the header and status are not counted
+        u32 seg_max = inportl(blk->io + REG_CONFIG + BLK_SEG_MAX);
+        if (seg_max < MAX_SEGMENTS) {
+            max_transfer = seg_max > 1 ? (seg_max - 1) * PAGE_SIZE / BLOCK_SECTOR_SIZE : 0;
+        }
+    }
+
+    if (max_transfer == 0) {
+        outportb(blk->io + REG_STATUS, STATUS_FAILED);
+        return false;
+    }
+
+    blk->dev = (struct BlockDevice) {
+        .name = NAMES[device_count],
+        .sectors = inportl(blk->io + REG_CONFIG + BLK_CAPACITY)
+            | ((u64) inportl(blk->io + REG_CONFIG + BLK_CAPACITY + 4) << 32),
+        .max_transfer = max_transfer,
+        .read = virtio_read,
+        .submit = virtio_submit
+    };
+
+    irq_install(blk->irq, virtio_irq);
+    outportb(blk->io + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+    return true;
+}
+
+size_t virtio_blk_init() {
+    struct PciDevice pci;
+    for (size_t i = 0; device_count < VIRTIO_MAX_DEVICES
+            && pci_find_device(VIRTIO_VENDOR, VIRTIO_DEVICE_BLK, i, &pci); i++) {
+        struct VirtioBlk *blk = &devices[device_count];
+        if (setup(blk, &pci)) {
+            block_register(&blk->dev);
+            device_count++;
+        }
+    }
+
+    return device_count;
+}
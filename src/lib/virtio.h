@@ -0,0 +1,11 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include "util.h"
+#include "block.h"
+
+// finds legacy virtio-pci block devices (QEMU -drive if=virtio) and registers
+// each as block device. needs the page allocator. returns the number found
+size_t virtio_blk_init();
+
+#endif
@@ -7,34 +7,261 @@
 #include "lib/font.h"
 #include "lib/system.h"
 #include "lib/keyboard.h"
-#include "os/sleep.h"
+#include "lib/multiboot.h"
+#include "lib/bootlog.h"
+#include "lib/bootinfo.h"
+#include "lib/page.h"
+#include "lib/ata.h"
+#include "lib/fdc.h"
+#include "lib/virtio.h"
+#include "lib/serial.h"
+#include "lib/cache.h"
+#include "lib/fat.h"
+#include "lib/paging.h"
+#include "lib/footprint.h"
+#include "lib/membench.h"
+#include "lib/fpu.h"
 #include "os/renderer.h"
 #include "os/music.h"
+#include "os/stream.h"
 
 char buf[64];
 
+/**
+ * sector sized buffers for reading headers and the like off disks
+ */
+#define SECTOR_BUFFERS 4
+struct Pool sectorPool;
+
+/**
+ * layout of the reports on the END screen. the right column fits 14
+ * characters, and a blank line between reports would not leave room for all
+ * of them, so they are only set apart by a few pixels
+ */
+#define REPORT_TOP 10
+#define REPORT_LINE (font_height() + 1)
+#define REPORT_GAP 2
+#define REPORT_RIGHT (SCREEN_WIDTH - 14 * 8)
+
+/**
+ * screen_swap calls averaged by timeSwap
+ */
+#define SWAP_SAMPLES 16
+
+/**
+ * TSC cycles per screen_swap with the framebuffer uncached, and after it was
+ * made write-combining (0 if that is not supported)
+ */
+u64 swapCycles[2];
+
+/**
+ * screen stats when playback started, so the average only covers frames
+ */
+struct ScreenStats playbackStart;
+
+#ifndef SCREEN_MODE_X
+/**
+ * @return the average TSC cycles a screen_swap of the whole screen takes,
+ * without the wait for the vertical retrace
+ */
+u64 timeSwap()
+{
+    u64 start = rdtsc();
+    for (size_t i = 0; i < SWAP_SAMPLES; i++)
+    {
+        screen_invalidate();
+        screen_swap_now();
+    }
+
+    return (rdtsc() - start) / SWAP_SAMPLES;
+}
+#endif
+
+/**
+ * append a number to buf
+ */
+void appendNumber(i32 value)
+{
+    char num[32];
+    itoa(value, num, sizeof(num));
+    strlcat(buf, num, sizeof(buf));
+}
+
+/**
+ * draw buf as a line of an END screen report, and write it to serial
+ */
+void showLine(size_t x, size_t y, u8 color)
+{
+    font_str(buf, x, y, color);
+    serial_write(buf);
+    serial_write("\n");
+}
+
+/**
+ * draw, and write to serial, the time swapCycles stand for, the bytes
+ * screen_swap wrote per frame during playback and how long it waited for the
+ * vertical retrace. returns the number of lines drawn
+ */
+size_t showSwapTimes(size_t x, size_t y, u8 color)
+{
+    const struct ScreenStats *stats = screen_stats();
+    u32 swaps = stats->swaps - playbackStart.swaps;
+    size_t lines = 0;
+
+    if (swapCycles[0] != 0)
+    {
+        strlcpy(buf, "SWAP UC ", sizeof(buf));
+        appendNumber((i32)bootlog_us(swapCycles[0]));
+        strlcat(buf, " us", sizeof(buf));
+        showLine(x, y + lines++ * REPORT_LINE, color);
+    }
+
+    if (swapCycles[1] != 0)
+    {
+        strlcpy(buf, "SWAP WC ", sizeof(buf));
+        appendNumber((i32)bootlog_us(swapCycles[1]));
+        strlcat(buf, " us", sizeof(buf));
+        showLine(x, y + lines++ * REPORT_LINE, color);
+    }
+
+    // average bytes written to video memory per frame
+    strlcpy(buf, "PRESENT ", sizeof(buf));
+    appendNumber(swaps != 0 ? (i32)udiv64(stats->total_bytes - playbackStart.total_bytes, swaps) : 0);
+    strlcat(buf, " B", sizeof(buf));
+    showLine(x, y + lines++ * REPORT_LINE, color);
+
+    // average wait for the retrace per frame, and the refresh rate
+    strlcpy(buf, "VS ", sizeof(buf));
+    appendNumber(swaps != 0 ? (i32)bootlog_us(udiv64(stats->vsync_cycles - playbackStart.vsync_cycles, swaps)) : 0);
+    strlcat(buf, "us ", sizeof(buf));
+    appendNumber((i32)stats->refresh_hz);
+    strlcat(buf, "HZ", sizeof(buf));
+    showLine(x, y + lines++ * REPORT_LINE, color);
+
+    return lines;
+}
+
+/**
+ * name of the clip on FAT formatted disks, in the root directory
+ */
+#define CLIP_FILE_NAME "FRAMES.CLP"
+
+/**
+ * make the clip stored in n extents of dev available, header holds its
+ * first sector. with paging, the clip is read page by page as the renderer
+ * touches it and only a window of it stays in memory. otherwise, or if it is
+ * too large to map, it is streamed into freshly allocated memory
+ *
+ * @return the clip, NULL if header is not a clip or there is no room
+ */
+const ClipHeader *loadClip(struct BlockDevice *dev, const struct BlockExtent *extents, size_t n, size_t size, const ClipHeader *header)
+{
+    if (header->magic != CLIP_MAGIC)
+        return NULL;
+
+    size = MIN(size, sizeof(ClipHeader) + header->size);
+    void *mapped = paging_map_demand(dev, extents, n, size);
+    if (mapped != NULL)
+        return mapped;
+
+    u8 *clip = page_alloc(PAGES(size));
+    if (clip == NULL)
+        return NULL;
+
+    // the first sector is here already, streaming it again hits the cache
+    memcpy(clip, header, BLOCK_SECTOR_SIZE);
+    stream_open_extents(dev, extents, n, clip, size);
+    return (const ClipHeader *)clip;
+}
+
+/**
+ * find a FAT volume with CLIP_FILE_NAME on it and load the file
+ *
+ * @return the clip, NULL if there is none
+ */
+const ClipHeader *openFileClip(ClipHeader *header)
+{
+    static struct FatVolume volume;
+    static struct FatFile file;
+
+    for (size_t i = 0; i < block_count(); i++)
+    {
+        if (!fat_mount(&volume, block_get(i))
+            || !fat_open(&volume, CLIP_FILE_NAME, &file)
+            || !fat_read(&file, 0, 1, header))
+            continue;
+
+        const ClipHeader *clip = loadClip(volume.dev, file.extents, file.extent_count, file.size, header);
+        if (clip != NULL)
+            return clip;
+    }
+
+    return NULL;
+}
+
+/**
+ * find a disk holding a clip, either as CLIP_FILE_NAME on a FAT volume or raw
+ * (i.e. bin/frames.clip as a QEMU drive), and load it
+ *
+ * @return the clip, NULL if there is none
+ */
+const ClipHeader *openDiskClip()
+{
+    static struct BlockExtent wholeDisk;
+
+    // only needed until the clip is loaded
+    ClipHeader *header = pool_alloc(&sectorPool);
+    if (header == NULL)
+        return NULL;
+
+    const ClipHeader *clip = openFileClip(header);
+    for (size_t i = 0; clip == NULL && i < block_count(); i++)
+    {
+        struct BlockDevice *dev = block_get(i);
+        if (!cache_read(dev, 0, 1, header))
+            continue;
+
+        wholeDisk.lba = 0;
+        wholeDisk.count = dev->sectors;
+        clip = loadClip(dev, &wholeDisk, 1, (size_t)MIN(dev->sectors * BLOCK_SECTOR_SIZE, (u64) ~(size_t)0), header);
+    }
+
+    pool_free(&sectorPool, header);
+    return clip;
+}
+
 void onRenderTick(u32 deltaTime)
 {
     music_tick(deltaTime);
+
+    // fetch the rest of the clip while waiting for the next frame
+    stream_poll();
 }
 
 void onRenderFrame(u32 frame, u32 deltaTime)
 {
-    // draw frame no
-    itoa(frame, buf, 64);
-    font_str(
-        buf,
-        0,
-        0,
-        COLOR(255, 0, 0));
+    // draw frame no and frame time, the text only lives for this frame
+    char *text = arena_alloc(&frameArena, 32);
+    if (text != NULL)
+    {
+        itoa(frame, text, 32);
+        font_str(
+            text,
+            0,
+            0,
+            COLOR(255, 0, 0));
+    }
 
-    // draw frame time
-    itoa(deltaTime, buf, 64);
-    font_str(
-        buf,
-        0,
-        10,
-        COLOR(255, 0, 0));
+    text = arena_alloc(&frameArena, 32);
+    if (text != NULL)
+    {
+        itoa(deltaTime, text, 32);
+        font_str(
+            text,
+            0,
+            10,
+            COLOR(255, 0, 0));
+    }
 
     // controlled in system.c
     const char *notification = get_notification();
@@ -44,18 +271,92 @@ void onRenderFrame(u32 frame, u32 deltaTime)
     }
 }
 
-void _main(u32 magic)
+/**
+ * draw, and write to serial, the most bytes the allocators had in use.
+ * returns the number of lines drawn
+ */
+size_t showMemoryUse(size_t x, size_t y, u8 color)
+{
+    strlcpy(buf, "ARENA ", sizeof(buf));
+    appendNumber((i32)frameArena.peak);
+    showLine(x, y, color);
+
+    strlcpy(buf, "POOL  ", sizeof(buf));
+    appendNumber((i32)(sectorPool.peak * sectorPool.block_size));
+    showLine(x, y + REPORT_LINE, color);
+
+    return 2;
+}
+
+void _main(u32 magic, u32 info)
 {
     // init kernel
+    bool multiboot = multiboot_init(magic, info);
+    bootlog_init(!multiboot);
+    bootinfo_init(!multiboot);
+    bootlog_mark(BOOT_MAIN);
+
+    // the screen picks its SSE2 kernels based on this
+    fpu_init();
+    page_init();
+    bootlog_mark(BOOT_MEMORY);
     idt_init();
+    bootlog_mark(BOOT_IDT);
     isr_init();
+    bootlog_mark(BOOT_ISR);
     irq_init();
+    bootlog_mark(BOOT_IRQ);
+
+    // without paging, disk clips are streamed into memory as a whole
+    paging_init();
+
+    // without stage0, nobody has asked the BIOS for mode 13h yet
+    if (multiboot)
+        screen_set_mode();
+
     screen_init();
+
+#ifndef SCREEN_MODE_X
+    // the framebuffer is uncached until the PAT says otherwise, time both.
+    // mode X switches planes between writes, they must not be combined
+    swapCycles[0] = timeSwap();
+    if (paging_write_combine(SCREEN_FRAMEBUFFER, SCREEN_SIZE))
+        swapCycles[1] = timeSwap();
+#endif
+    bootlog_mark(BOOT_SCREEN);
     timer_init();
+    bootlog_mark(BOOT_TIMER);
     keyboard_init();
+    bootlog_mark(BOOT_KEYBOARD);
     music_init();
+    bootlog_mark(BOOT_MUSIC);
+    serial_init();
+
+    ata_init();
+    fdc_init();
+    virtio_blk_init();
+    cache_init();
+    pool_init(&sectorPool, BLOCK_SECTOR_SIZE, SECTOR_BUFFERS);
+
+    // the clip is either passed as multiboot module, on a data disk of its own,
+    // or stage0 loaded its start from the boot image. the last two are
+    // streamed in during playback
+    const struct MultibootModule *module = multiboot_module(0);
+    const struct BootInfo *bootInfo = bootinfo_get();
+    const ClipHeader *clip = module != NULL ? (const ClipHeader *)module->start : openDiskClip();
+    if (clip == NULL && bootInfo != NULL && bootInfo->image->clip != 0)
+    {
+        clip = (const ClipHeader *)bootInfo->image->clip;
+        stream_init();
+    }
+
+    if (!renderer_set_clip(clip))
+        notify("NO CLIP");
 
-    // draw "ready"
+    bootlog_mark(BOOT_READY);
+    bootlog_calibrate();
+
+    // draw "ready", playback starts right away
     screen_clear(COLOR(0, 0, 0));
     font_str(
         "READY",
@@ -63,9 +364,10 @@ void _main(u32 magic)
         SCREEN_HEIGHT / 2,
         COLOR(255, 255, 255));
     screen_swap();
-    sleep(5);
+    bootlog_dump();
 
     // render the full movie
+    playbackStart = *screen_stats();
     u32 frameCount = render(onRenderTick, onRenderFrame);
 
     // draw "end"
@@ -81,6 +383,35 @@ void _main(u32 magic)
         0,
         0,
         COLOR(255, 0, 0));
+
+    // the reports below are stacked in two columns, each one right below
+    // the lines the one before it drew
+    size_t left = REPORT_TOP, right = REPORT_TOP;
+
+    // and the time each boot phase took
+    left += bootlog_draw(0, left, COLOR(255, 0, 0)) * REPORT_LINE + REPORT_GAP;
+
+    // and how the string functions compare to the byte loops they replaced,
+    // measured now so boot and playback do not pay for it
+    membench_run();
+    left += membench_draw(0, left, COLOR(255, 0, 0)) * REPORT_LINE + REPORT_GAP;
+    membench_dump();
+
+    // and how well the block cache kept up with the stream
+    right += cache_draw(REPORT_RIGHT, right, COLOR(255, 0, 0)) * REPORT_LINE + REPORT_GAP;
+    cache_dump();
+
+    // and what write-combining and the dirty spans did for screen_swap. the
+    // refresh rate is measured now, so boot does not wait for it
+    screen_measure_refresh();
+    right += showSwapTimes(REPORT_RIGHT, right, COLOR(255, 0, 0)) * REPORT_LINE + REPORT_GAP;
+
+    // and how much scratch memory playback needed
+    right += showMemoryUse(REPORT_RIGHT, right, COLOR(255, 0, 0)) * REPORT_LINE + REPORT_GAP;
+
+    // and how much room is left on the stack and in memory
+    footprint_draw(REPORT_RIGHT, right, COLOR(255, 0, 0));
+    footprint_dump();
     screen_swap();
     while (true)
         ;
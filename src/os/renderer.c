@@ -18,9 +18,32 @@
  *
  * final config:
  * 0    | -     | 5     | 50            | 70                | 392k
+ * ---
+ * the kernel is now linked at 1M and stage0 copies it there through unreal mode,
+ * so the back buffers can no longer run into the VGA memory at 0xA0000.
+ * link.ld and mkimage now fail the build if anything is placed at 0xA0000-0xFFFFF.
+ * ---
+ * the frames are no longer compiled into the kernel. they are a clip placed after
+ * it in the image, of which stage0 only loads the start (see stream.c).
  */
-bool renderFrame(const u8 *rects, u32 frameNo)
+static const ClipHeader *activeClip = NULL;
+
+struct Arena frameArena;
+
+bool renderer_set_clip(const ClipHeader *clip)
+{
+    if (clip == NULL || clip->magic != CLIP_MAGIC)
+        return false;
+
+    activeClip = clip;
+    return true;
+}
+
+bool renderFrame(const u8 **frame, u32 frameNo)
 {
+    // rects is advanced past the frame, so frames stored back to back can be read in sequence
+    const u8 *rects = *frame;
+
     /*
      * format of the rects data is as follows:
      * - first two bytes are the screen and rectangle colors
@@ -32,12 +55,22 @@ bool renderFrame(const u8 *rects, u32 frameNo)
      * - end condition: screen and rect color are equal
      */
     // get screen and rectangle color
+    // a frame that can not be streamed in ends the movie early
+    if (!stream_has(rects, 2))
+    {
+        *frame = rects;
+        return true;
+    }
+
     u8 screenColor = next(rects);
     u8 rectColor = next(rects);
 
     // check for end condition
     if (screenColor == rectColor)
+    {
+        *frame = rects;
         return true;
+    }
 
     // clear the screen with the screen color
     screen_clear(screenColor);
@@ -49,6 +82,12 @@ bool renderFrame(const u8 *rects, u32 frameNo)
     u8 rectsCount = 0;
     do
     {
+        if (!stream_has(rects, 5))
+        {
+            *frame = rects;
+            return true;
+        }
+
         // read 5 bytes into data
         for (u8 i = 0; i < 5; i++)
         {
@@ -63,14 +102,13 @@ bool renderFrame(const u8 *rects, u32 frameNo)
         w = (data >> 9) & 0x1FF;
         h = data & 0x1FF;
 
-        // draw rectangle to screen
-        for (size_t sx = x; sx < (x + w); sx++)
-            for (size_t sy = y; sy < (y + h); sy++)
-                screen_offset(sx, sy) = rectColor;
+        // draw rectangle to screen, row by row so screen_swap knows the spans
+        screen_fill(rectColor, x, y, w, h);
 
         rectsCount++;
     } while ((flags & FLAG_LAST_RECT) == 0);
-    
+
+    *frame = rects;
     return false;
 }
 
@@ -79,9 +117,21 @@ u32 render(TickCallback onTick, FrameCallback onFrame)
     u32 now,
         deltaTime,
         lastTick = 0,
-        frameDeltaTime = 0,
         frameCounter = 0;
-    const u8 *rects;
+    if (activeClip == NULL)
+        return 0;
+
+    // without memory for it, every allocation from the arena fails
+    arena_init(&frameArena, FRAME_ARENA_SIZE);
+
+    // frames are due at fixed times from the start, so neither rounding nor
+    // late frames add up. screen_swap then holds each one until the next
+    // vertical retrace, which puts the cadence on the display refresh
+    u32 start = (u32)timer_get(),
+        nextFrame = start,
+        lastFrame = start;
+
+    const u8 *rects = (const u8 *)(activeClip + 1);
     for (;;)
     {
         // handle ticking
@@ -91,14 +141,11 @@ u32 render(TickCallback onTick, FrameCallback onFrame)
         onTick(deltaTime);
 
         // handle frames
-        frameDeltaTime += deltaTime;
-        if (frameDeltaTime > (TIMER_TPS / FPS))
+        if ((i32)(now - nextFrame) >= 0)
         {
-            // get rects for next frame
-            rects = rectData[frameCounter];
-
-            // render next frame
-            bool eof = renderFrame(rects, frameCounter);
+            // render next frame, clips are read in sequence
+            arena_reset(&frameArena);
+            bool eof = renderFrame(&rects, frameCounter);
 
             // increment frame counter
             frameCounter++;
@@ -108,9 +155,10 @@ u32 render(TickCallback onTick, FrameCallback onFrame)
                 break;
 
             // finish the frame
-            onFrame(frameCounter, frameDeltaTime);
+            onFrame(frameCounter, now - lastFrame);
             screen_swap();
-            frameDeltaTime = 0;
+            lastFrame = now;
+            nextFrame = start + (u32)udiv64((u64)frameCounter * TIMER_TPS, FPS);
         }
     }
 
@@ -2,6 +2,8 @@
 #include "../lib/screen.h"
 #include "../lib/timer.h"
 #include "../lib/font.h"
+#include "../lib/alloc.h"
+#include "stream.h"
 
 #define FPS 7
 #define next(ptr) (*((ptr)++))
@@ -10,11 +12,41 @@
 #define FLAG_C 0x2
 #define FLAG_D 0x1
 
-extern const u8 *rectData[];
+#define CLIP_MAGIC 0x4C434142
+
+/**
+ * bytes of scratch memory per frame, see frameArena
+ */
+#define FRAME_ARENA_SIZE (16 * 1024)
 
 typedef void (*FrameCallback)(u32, u32);
 typedef void (*TickCallback)(u32);
 
+/**
+ * header of a standalone clip, written by tools/mkclip.c.
+ * it is followed by all frames back to back.
+ */
+typedef struct ClipHeader
+{
+    u32 magic;
+    u32 size;
+    u32 frames;
+    u32 __reserved;
+} ClipHeader;
+
+/**
+ * scratch memory for the frame being drawn, emptied before every frame.
+ * set up by render
+ */
+extern struct Arena frameArena;
+
+/**
+ * set the clip to play, its frames may still be streaming in
+ *
+ * @return false if clip is not a valid clip
+ */
+bool renderer_set_clip(const ClipHeader *clip);
+
 /**
  * render the full movie
  *
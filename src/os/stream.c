@@ -0,0 +1,164 @@
+#include "stream.h"
+#include "../lib/block.h"
+#include "../lib/bootinfo.h"
+#include "../lib/cache.h"
+
+/**
+ * sectors read per poll without DMA, small enough to fit between two frames
+ */
+#define CHUNK_SECTORS 16
+
+/**
+ * sectors copied per poll with DMA, the cache reads them in the background
+ */
+#define DMA_CHUNK_SECTORS 64
+
+const u8 *streamEnd = (const u8 *)~0u;
+
+static const u8 *segmentEnd = NULL;
+static bool failed = false;
+static struct BlockDevice *disk = NULL;
+
+/**
+ * runs of sectors the stream is read from, in order. nextSector is the
+ * next one to read within the current extent
+ */
+static const struct BlockExtent *extents = NULL;
+static size_t extentCount = 0, currentExtent = 0;
+static u64 nextSector = 0;
+
+/**
+ * the single extent of a stream opened with stream_open
+ */
+static struct BlockExtent wholeStream;
+
+/**
+ * find the disk stage0 booted from, by comparing the image header on each
+ * disk with the one stage0 left in memory
+ */
+static struct BlockDevice *findBootDisk(const struct BootInfo *info)
+{
+    static u32 sector[BLOCK_SECTOR_SIZE / 4];
+    const u32 *header = (const u32 *)info->image;
+
+    for (size_t i = 0; i < block_count(); i++)
+    {
+        struct BlockDevice *dev = block_get(i);
+        if (!block_read(dev, info->image_sector, 1, sector))
+            continue;
+
+        size_t j = 0;
+        while (j < BLOCK_SECTOR_SIZE / 4 && sector[j] == header[j])
+            j++;
+
+        if (j == BLOCK_SECTOR_SIZE / 4)
+            return dev;
+    }
+
+    return NULL;
+}
+
+bool stream_open(struct BlockDevice *dev, u64 lba, void *dst, size_t size)
+{
+    wholeStream.lba = lba;
+    wholeStream.count = (size + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+    return stream_open_extents(dev, &wholeStream, 1, dst, size);
+}
+
+bool stream_open_extents(struct BlockDevice *dev, const struct BlockExtent *runs, size_t count, void *dst, size_t size)
+{
+    disk = dev;
+    extents = runs;
+    extentCount = count;
+    currentExtent = 0;
+    nextSector = 0;
+    streamEnd = dst;
+    segmentEnd = (const u8 *)dst + size;
+    failed = disk == NULL;
+    return !failed;
+}
+
+bool stream_init()
+{
+    const struct BootInfo *info = bootinfo_get();
+    if (info == NULL)
+        return false;
+
+    // segments are stored back to back after the header, each padded to a sector
+    const struct ImageHeader *image = info->image;
+    u32 sector = info->image_sector + 1;
+    for (size_t i = 0; i < image->segment_count; i++)
+    {
+        const struct ImageSegment *segment = &image->segments[i];
+
+        if (segment->boot_size < segment->file_size)
+        {
+            // without the disk, playback ends after what stage0 loaded
+            return stream_open(
+                findBootDisk(info),
+                sector + segment->boot_size / BLOCK_SECTOR_SIZE,
+                (void *)(segment->addr + segment->boot_size),
+                segment->file_size - segment->boot_size);
+        }
+
+        sector += (segment->file_size + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+    }
+
+    return false;
+}
+
+void stream_poll()
+{
+    if (failed || segmentEnd == NULL || streamEnd >= segmentEnd)
+        return;
+
+    while (currentExtent < extentCount && nextSector >= extents[currentExtent].count)
+    {
+        currentExtent++;
+        nextSector = 0;
+    }
+
+    // the extents end before the segment does
+    if (currentExtent == extentCount)
+    {
+        failed = true;
+        return;
+    }
+
+    // the segment is padded to whole sectors in memory. reads never cross
+    // into the next extent, within one they are as long as allowed
+    const struct BlockExtent *extent = &extents[currentExtent];
+    size_t count = (segmentEnd - streamEnd + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+    count = MIN(count, (size_t)(disk->submit != NULL ? DMA_CHUNK_SECTORS : CHUNK_SECTORS));
+    count = (size_t)MIN((u64)count, extent->count - nextSector);
+    u64 lba = extent->lba + nextSector;
+
+    // with DMA, only copy once the cache has the sectors, so playback never
+    // waits on the disk. read-ahead keeps the following ones coming
+    if (!cache_ready(disk, lba, count))
+        return;
+
+    if (!cache_read(disk, lba, count, (void *)streamEnd))
+    {
+        failed = true;
+        return;
+    }
+
+    nextSector += count;
+    streamEnd += count * BLOCK_SECTOR_SIZE;
+    if (streamEnd > segmentEnd)
+        streamEnd = segmentEnd;
+}
+
+bool stream_wait(const void *end)
+{
+    while (streamEnd < (const u8 *)end)
+    {
+        if (failed || segmentEnd == NULL || streamEnd >= segmentEnd)
+            return false;
+
+        stream_poll();
+    }
+
+    return true;
+}
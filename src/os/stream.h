@@ -0,0 +1,58 @@
+#ifndef STREAM_H
+#define STREAM_H
+#include "../lib/util.h"
+#include "../lib/block.h"
+
+/**
+ * end of the streamed data that is in memory.
+ * without a streamed segment, everything is in memory.
+ */
+extern const u8 *streamEnd;
+
+/**
+ * find the image segment stage0 only loaded in part, i.e. the clip, so the rest
+ * of it can be read from disk while it is already being played.
+ * block devices must be registered before
+ *
+ * @return false if there is nothing to stream
+ */
+bool stream_init();
+
+/**
+ * stream size bytes starting at sector lba of dev to dst, replaces the
+ * current stream. dev may be NULL, then nothing past dst is ever available
+ *
+ * @return false if dev is NULL
+ */
+bool stream_open(struct BlockDevice *dev, u64 lba, void *dst, size_t size);
+
+/**
+ * like stream_open, but the data is spread over count runs of sectors on dev,
+ * e.g. the fragments of a file. runs must stay valid while streaming
+ *
+ * @return false if dev is NULL
+ */
+bool stream_open_extents(struct BlockDevice *dev, const struct BlockExtent *runs, size_t count, void *dst, size_t size);
+
+/**
+ * read the next chunk of the streamed segment, call whenever there is time
+ */
+void stream_poll();
+
+/**
+ * read until everything before end is in memory
+ *
+ * @return false if end can not be reached
+ */
+bool stream_wait(const void *end);
+
+/**
+ * @return true once the n bytes at ptr are in memory, reading them if needed
+ */
+static inline bool stream_has(const void *ptr, size_t n)
+{
+    const u8 *end = (const u8 *)ptr + n;
+    return end <= streamEnd || stream_wait(end);
+}
+
+#endif
@@ -0,0 +1,151 @@
+// minimal 32-bit ELF reading shared by the build tools
+#ifndef TOOLS_ELF_H
+#define TOOLS_ELF_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ELF_MAGIC 0x464C457F
+#define ELF_CLASS_32 1
+#define ELF_DATA_LSB 1
+#define ELF_MACHINE_386 3
+#define PT_LOAD 1
+#define SHT_SYMTAB 2
+
+struct ElfHeader {
+    uint32_t magic;
+    uint8_t class, data, version, abi;
+    uint8_t __ignored[8];
+    uint16_t type, machine;
+    uint32_t version2, entry, phoff, shoff, flags;
+    uint16_t ehsize, phentsize, phnum, shentsize, shnum, shstrndx;
+};
+
+struct ElfProgramHeader {
+    uint32_t type, offset, vaddr, paddr, filesz, memsz, flags, align;
+};
+
+struct ElfSectionHeader {
+    uint32_t name, type, flags, addr, offset, size, link, info, addralign, entsize;
+};
+
+struct ElfSymbol {
+    uint32_t name, value, size;
+    uint8_t info, other;
+    uint16_t shndx;
+};
+
+struct Elf {
+    uint8_t *data;
+    size_t size;
+    struct ElfHeader header;
+};
+
+static void fail(const char *msg);
+
+static void elf_load(struct Elf *elf, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fail("cannot open input");
+    }
+
+    fseek(f, 0, SEEK_END);
+    elf->size = (size_t) ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    elf->data = malloc(elf->size);
+    if (elf->data == NULL || fread(elf->data, 1, elf->size, f) != elf->size) {
+        fail("cannot read input");
+    }
+
+    fclose(f);
+
+    struct ElfHeader *eh = &elf->header;
+    if (elf->size < sizeof(*eh)) {
+        fail("input is not an ELF file");
+    }
+    memcpy(eh, elf->data, sizeof(*eh));
+
+    if (eh->magic != ELF_MAGIC || eh->class != ELF_CLASS_32
+            || eh->data != ELF_DATA_LSB || eh->machine != ELF_MACHINE_386) {
+        fail("input is not a 32-bit x86 ELF file");
+    }
+
+    if (eh->phentsize != sizeof(struct ElfProgramHeader)
+            || eh->phoff + (size_t) eh->phnum * eh->phentsize > elf->size) {
+        fail("bad program header table");
+    }
+}
+
+static struct ElfProgramHeader elf_program_header(const struct Elf *elf, uint16_t i) {
+    struct ElfProgramHeader ph;
+    memcpy(&ph, elf->data + elf->header.phoff + i * elf->header.phentsize, sizeof(ph));
+    return ph;
+}
+
+// returns a pointer to the file bytes backing vaddr, NULL if there are none
+static inline const uint8_t *elf_at(const struct Elf *elf, uint32_t vaddr, uint32_t len) {
+    for (uint16_t i = 0; i < elf->header.phnum; i++) {
+        struct ElfProgramHeader ph = elf_program_header(elf, i);
+        if (ph.type == PT_LOAD && vaddr >= ph.vaddr
+                && (uint64_t) vaddr + len <= (uint64_t) ph.vaddr + ph.filesz
+                && (size_t) ph.offset + ph.filesz <= elf->size) {
+            return elf->data + ph.offset + (vaddr - ph.vaddr);
+        }
+    }
+
+    return NULL;
+}
+
+// looks up the value of a symbol, returns false if it does not exist
+static int elf_symbol(const struct Elf *elf, const char *name, uint32_t *value) {
+    const struct ElfHeader *eh = &elf->header;
+    if (eh->shentsize != sizeof(struct ElfSectionHeader)
+            || eh->shoff + (size_t) eh->shnum * eh->shentsize > elf->size) {
+        fail("bad section header table");
+    }
+
+    for (uint16_t i = 0; i < eh->shnum; i++) {
+        struct ElfSectionHeader sh, strtab;
+        memcpy(&sh, elf->data + eh->shoff + i * eh->shentsize, sizeof(sh));
+
+        if (sh.type != SHT_SYMTAB || sh.link >= eh->shnum) {
+            continue;
+        }
+
+        memcpy(&strtab, elf->data + eh->shoff + sh.link * eh->shentsize, sizeof(strtab));
+        if ((size_t) sh.offset + sh.size > elf->size
+                || (size_t) strtab.offset + strtab.size > elf->size) {
+            fail("bad symbol table");
+        }
+
+        for (uint32_t j = 0; j < sh.size / sizeof(struct ElfSymbol); j++) {
+            struct ElfSymbol sym;
+            memcpy(&sym, elf->data + sh.offset + j * sizeof(sym), sizeof(sym));
+
+            if (sym.name < strtab.size
+                    && strncmp((const char *) elf->data + strtab.offset + sym.name,
+                        name, strtab.size - sym.name) == 0) {
+                *value = sym.value;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+#endif
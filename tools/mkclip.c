@@ -0,0 +1,109 @@
+// mkclip: extracts the frame data compiled from frames.c into a standalone clip
+// that can be handed to the kernel at runtime (e.g. as a multiboot module).
+//
+// the clip starts with a 16 byte header:
+//  - u32 magic (CLIP_MAGIC)
+//  - u32 size of the frame data in bytes
+//  - u32 number of frames
+//  - u32 reserved
+//
+// followed by all frames of rectData[] back to back, including the end
+// condition, in the format described in renderer.c. the file is padded to a
+// full sector.
+//
+// usage: mkclip <frames.elf> <frames.clip>
+#include "elf.h"
+
+#define SECTOR_SIZE 512
+#define CLIP_MAGIC 0x4C434142 // "BACL"
+#define CLIP_HEADER_SIZE 16
+#define FLAG_LAST_RECT 0x8
+
+static void fail(const char *msg) {
+    fprintf(stderr, "mkclip: %s\n", msg);
+    exit(1);
+}
+
+// returns the size of the frame at vaddr in bytes, 2 for the end condition
+static uint32_t frame_size(const struct Elf *elf, uint32_t vaddr) {
+    const uint8_t *colors = elf_at(elf, vaddr, 2);
+    if (colors == NULL) {
+        fail("frame outside of the ELF file");
+    }
+
+    // end condition: screen and rect color are equal
+    if (colors[0] == colors[1]) {
+        return 2;
+    }
+
+    uint32_t size = 2;
+    for (;;) {
+        const uint8_t *rect = elf_at(elf, vaddr + size, 5);
+        if (rect == NULL) {
+            fail("frame outside of the ELF file");
+        }
+
+        size += 5;
+        if (((rect[0] >> 4) & FLAG_LAST_RECT) != 0) {
+            return size;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <frames.elf> <frames.clip>\n", argv[0]);
+        return 1;
+    }
+
+    struct Elf elf;
+    elf_load(&elf, argv[1]);
+
+    uint32_t table;
+    if (!elf_symbol(&elf, "rectData", &table)) {
+        fail("no rectData symbol");
+    }
+
+    FILE *out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        fail("cannot open output");
+    }
+
+    // header is written last, once the sizes are known
+    uint8_t header[CLIP_HEADER_SIZE] = { 0 };
+    fwrite(header, 1, sizeof(header), out);
+
+    uint32_t frames = 0, size = 0;
+    for (;; frames++) {
+        const uint8_t *entry = elf_at(&elf, table + frames * 4, 4);
+        if (entry == NULL) {
+            fail("rectData ends without an end condition");
+        }
+
+        uint32_t frame = get32(entry), len = frame_size(&elf, frame);
+        fwrite(elf_at(&elf, frame, len), 1, len, out);
+        size += len;
+
+        if (len == 2) {
+            break;
+        }
+    }
+
+    static const uint8_t padding[SECTOR_SIZE] = { 0 };
+    fwrite(padding, 1, (SECTOR_SIZE - (CLIP_HEADER_SIZE + size) % SECTOR_SIZE) % SECTOR_SIZE, out);
+
+    put32(&header[0], CLIP_MAGIC);
+    put32(&header[4], size);
+    put32(&header[8], frames);
+    fseek(out, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), out);
+
+    printf("mkclip: %u frames, %u bytes\n", frames, size);
+
+    if (fclose(out) != 0) {
+        fail("cannot write output");
+    }
+
+    free(elf.data);
+    return 0;
+}
@@ -0,0 +1,418 @@
+// mkimage: converts the linked kernel ELF into the boot image read by stage0.
+//
+// the image starts with a single sector header:
+//  - u32 magic (IMAGE_MAGIC)
+//  - u32 entry point
+//  - u32 number of segments
+//  - u32 address of the clip, 0 if there is none
+//  - up to IMAGE_MAX_SEGMENTS segments of:
+//      u32 physical load address
+//      u32 file size (bytes stored in the image)
+//      u32 memory size (file size + bytes to zero, i.e. .bss)
+//      u32 boot size (file bytes stage0 reads, the rest is streamed)
+//
+// it is followed by the file bytes of every PT_LOAD segment, each padded to a
+// full sector. stage0 reads exactly these sectors, gaps between sections and
+// .bss are never stored.
+//
+// with -c, a clip (see mkclip.c) is appended as the last segment, placed in
+// memory past the kernel. its boot size is limited to the -p preload bytes, so
+// playback can start while the kernel streams in the rest from disk.
+//
+// with -z, every segment except the one holding the entry point is stored LZ4
+// compressed (block format). stage0 loads the compressed blocks to a staging
+// area past the end of the kernel, and the prologue in start.S expands them to
+// their real address using the table at lz4_table, which is filled in here.
+//
+// usage: mkimage [-z] [-c <clip> [-p <preload bytes>]] <kernel.elf> <kernel.bin>
+#include "elf.h"
+
+#include <unistd.h>
+
+#define SECTOR_SIZE 512
+#define IMAGE_MAGIC 0x534F4142 // "BAOS"
+#define IMAGE_HEADER_SIZE 16
+#define IMAGE_SEGMENT_SIZE 16
+#define IMAGE_MAX_SEGMENTS ((SECTOR_SIZE - IMAGE_HEADER_SIZE) / IMAGE_SEGMENT_SIZE)
+
+// VGA window and BIOS area, stage0 must never load anything there
+#define VGA_HOLE_START 0xA0000
+#define VGA_HOLE_END 0x100000
+
+// must match mkclip.c
+#define CLIP_MAGIC 0x4C434142 // "BACL"
+#define CLIP_HEADER_SIZE 16
+
+// must match lz4_table in start.S
+#define LZ4_TABLE_ENTRIES 4
+#define LZ4_ENTRY_SIZE 12
+
+// LZ4 block format constraints
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 16
+
+struct Segment {
+    uint32_t addr, file_size, mem_size, boot_size;
+    const uint8_t *data;
+};
+
+static void fail(const char *msg) {
+    fprintf(stderr, "mkimage: %s\n", msg);
+    exit(1);
+}
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint8_t *lz4_length(uint8_t *out, size_t len) {
+    for (; len >= 255; len -= 255) {
+        *out++ = 255;
+    }
+
+    *out++ = (uint8_t) len;
+    return out;
+}
+
+// greedy single-pass LZ4 block compressor, returns the compressed size.
+// out must hold at least n + n / 255 + 16 bytes
+static size_t lz4_compress(const uint8_t *in, size_t n, uint8_t *out) {
+    static uint32_t table[1 << LZ4_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint8_t *o = out;
+    size_t ip = 0, anchor = 0;
+
+    while (ip + LZ4_MATCH_LIMIT <= n) {
+        uint32_t v = read32(&in[ip]),
+                 h = (v * 2654435761u) >> (32 - LZ4_HASH_BITS),
+                 ref = table[h];
+
+        // positions are stored + 1, so 0 is empty
+        table[h] = ip + 1;
+
+        if (ref == 0 || ip - (ref - 1) > LZ4_MAX_OFFSET || read32(&in[ref - 1]) != v) {
+            ip++;
+            continue;
+        }
+
+        ref--;
+
+        size_t match = LZ4_MIN_MATCH;
+        while (ip + match < n - LZ4_LAST_LITERALS && in[ref + match] == in[ip + match]) {
+            match++;
+        }
+
+        size_t literals = ip - anchor;
+        uint8_t *token = o++;
+        *token = (uint8_t) (((literals < 15 ? literals : 15) << 4)
+            | (match - LZ4_MIN_MATCH < 15 ? match - LZ4_MIN_MATCH : 15));
+
+        if (literals >= 15) {
+            o = lz4_length(o, literals - 15);
+        }
+
+        memcpy(o, &in[anchor], literals);
+        o += literals;
+
+        *o++ = (ip - ref) & 0xFF;
+        *o++ = ((ip - ref) >> 8) & 0xFF;
+
+        if (match - LZ4_MIN_MATCH >= 15) {
+            o = lz4_length(o, match - LZ4_MIN_MATCH - 15);
+        }
+
+        ip += match;
+        anchor = ip;
+    }
+
+    // last sequence is literals only
+    size_t literals = n - anchor;
+    *o++ = (uint8_t) ((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) {
+        o = lz4_length(o, literals - 15);
+    }
+
+    memcpy(o, &in[anchor], literals);
+    o += literals;
+
+    return (size_t) (o - out);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-z] [-c <clip> [-p <preload bytes>]] <kernel.elf> <kernel.bin>\n", name);
+    exit(1);
+}
+
+// reads the whole clip, padded to a full sector
+static uint8_t *load_clip(const char *path, uint32_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fail("cannot open clip");
+    }
+
+    fseek(f, 0, SEEK_END);
+    *size = (uint32_t) ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *data = calloc(1, *size + SECTOR_SIZE);
+    if (data == NULL || fread(data, 1, *size, f) != *size) {
+        fail("cannot read clip");
+    }
+
+    fclose(f);
+
+    if (*size < CLIP_HEADER_SIZE || get32(data) != CLIP_MAGIC) {
+        fail("input is not a clip");
+    }
+
+    return data;
+}
+
+int main(int argc, char **argv) {
+    int compress = 0, opt;
+    const char *clip_path = NULL;
+    uint32_t preload = UINT32_MAX;
+    while ((opt = getopt(argc, argv, "zc:p:")) != -1) {
+        switch (opt) {
+        case 'z':
+            compress = 1;
+            break;
+        case 'c':
+            clip_path = optarg;
+            break;
+        case 'p':
+            preload = (uint32_t) strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
+    }
+
+    struct Elf elf;
+    elf_load(&elf, argv[optind]);
+    const struct ElfHeader eh = elf.header;
+
+    // collect loadable segments
+    struct Segment segments[IMAGE_MAX_SEGMENTS];
+    uint32_t count = 0, end = 0;
+    int entry = -1;
+    for (uint16_t i = 0; i < eh.phnum; i++) {
+        struct ElfProgramHeader ph = elf_program_header(&elf, i);
+
+        if (ph.type != PT_LOAD || ph.memsz == 0) {
+            continue;
+        }
+
+        if (count == IMAGE_MAX_SEGMENTS) {
+            fail("too many segments");
+        }
+
+        if ((size_t) ph.offset + ph.filesz > elf.size || ph.filesz > ph.memsz) {
+            fail("bad segment");
+        }
+
+        if (eh.entry >= ph.paddr && eh.entry < ph.paddr + ph.filesz) {
+            entry = count;
+        }
+
+        if (ph.paddr + ph.memsz > end) {
+            end = ph.paddr + ph.memsz;
+        }
+
+        segments[count++] = (struct Segment) {
+            .addr = ph.paddr,
+            .file_size = ph.filesz,
+            .mem_size = ph.memsz,
+            .boot_size = ph.filesz,
+            .data = elf.data + ph.offset
+        };
+    }
+
+    if (count == 0) {
+        fail("no loadable segments");
+    }
+
+    if (compress) {
+        if (entry < 0) {
+            fail("entry point is not in a loadable segment");
+        }
+
+        uint32_t table;
+        if (!elf_symbol(&elf, "lz4_table", &table)) {
+            fail("no lz4_table symbol");
+        }
+
+        struct Segment *prologue = &segments[entry];
+        if (table < prologue->addr
+                || table + 4 + LZ4_TABLE_ENTRIES * LZ4_ENTRY_SIZE > prologue->addr + prologue->file_size) {
+            fail("lz4_table is not in the entry segment");
+        }
+
+        // the entry segment is patched, so it needs its own copy
+        uint8_t *patched = malloc(prologue->file_size);
+        if (patched == NULL) {
+            fail("out of memory");
+        }
+        memcpy(patched, prologue->data, prologue->file_size);
+        prologue->data = patched;
+        uint8_t *lz4_table = patched + (table - prologue->addr);
+
+        // compressed blocks are staged past everything the kernel occupies
+        uint32_t staging = (end + 0xFFF) & ~0xFFF, blocks = 0;
+
+        struct Segment compressed[IMAGE_MAX_SEGMENTS];
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            struct Segment s = segments[i];
+
+            if ((int) i == entry || s.file_size == 0) {
+                compressed[n++] = s;
+                continue;
+            }
+
+            if (blocks == LZ4_TABLE_ENTRIES) {
+                fail("too many segments to compress");
+            }
+
+            uint8_t *block = malloc(s.file_size + s.file_size / 255 + 16);
+            if (block == NULL) {
+                fail("out of memory");
+            }
+
+            uint32_t size = (uint32_t) lz4_compress(s.data, s.file_size, block);
+
+            uint8_t *e = &lz4_table[4 + blocks * LZ4_ENTRY_SIZE];
+            put32(&e[0], staging);
+            put32(&e[4], size);
+            put32(&e[8], s.addr);
+            blocks++;
+
+            printf(
+                "mkimage: segment at 0x%08x compressed from %u to %u bytes\n",
+                s.addr, s.file_size, size);
+
+            // the compressed block, plus the part stage0 has to zero
+            if (n + 2 > IMAGE_MAX_SEGMENTS) {
+                fail("too many segments");
+            }
+
+            compressed[n++] = (struct Segment) {
+                .addr = staging,
+                .file_size = size,
+                .mem_size = size,
+                .boot_size = size,
+                .data = block
+            };
+
+            if (s.mem_size > s.file_size) {
+                compressed[n++] = (struct Segment) {
+                    .addr = s.addr + s.file_size,
+                    .file_size = 0,
+                    .mem_size = s.mem_size - s.file_size,
+                    .data = NULL
+                };
+            }
+
+            staging = (staging + size + 3) & ~3;
+        }
+
+        put32(&lz4_table[0], blocks);
+        memcpy(segments, compressed, n * sizeof(struct Segment));
+        count = n;
+        end = staging;
+    }
+
+    // the clip goes last, so the segments stage0 reads in full come first
+    uint32_t clip_addr = 0;
+    if (clip_path != NULL) {
+        if (count == IMAGE_MAX_SEGMENTS) {
+            fail("too many segments");
+        }
+
+        uint32_t size;
+        const uint8_t *clip = load_clip(clip_path, &size);
+
+        // stage0 copies whole sectors, so the preload is rounded up to one
+        if (preload < size) {
+            preload = (preload + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+        }
+
+        // memory is rounded up to a sector, the kernel streams whole sectors
+        clip_addr = (end + 0xFFF) & ~0xFFF;
+        segments[count++] = (struct Segment) {
+            .addr = clip_addr,
+            .file_size = size,
+            .mem_size = (size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1),
+            .boot_size = preload < size ? preload : size,
+            .data = clip
+        };
+
+        printf(
+            "mkimage: clip at 0x%08x, %u bytes (%u preloaded)\n",
+            clip_addr, size, segments[count - 1].boot_size);
+    }
+
+    // link.ld checks the kernel sections, this also covers the staging area
+    // and the clip placed after them
+    for (uint32_t i = 0; i < count; i++) {
+        if (segments[i].addr < VGA_HOLE_END
+                && segments[i].addr + segments[i].mem_size > VGA_HOLE_START) {
+            fail("segment overlaps the VGA hole at 0xA0000-0xFFFFF");
+        }
+    }
+
+    // header sector
+    uint8_t header[SECTOR_SIZE] = { 0 };
+    put32(&header[0], IMAGE_MAGIC);
+    put32(&header[4], eh.entry);
+    put32(&header[8], count);
+    put32(&header[12], clip_addr);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t *s = &header[IMAGE_HEADER_SIZE + i * IMAGE_SEGMENT_SIZE];
+        put32(&s[0], segments[i].addr);
+        put32(&s[4], segments[i].file_size);
+        put32(&s[8], segments[i].mem_size);
+        put32(&s[12], segments[i].boot_size);
+    }
+
+    FILE *out = fopen(argv[optind + 1], "wb");
+    if (out == NULL) {
+        fail("cannot open output");
+    }
+
+    fwrite(header, 1, sizeof(header), out);
+
+    // segment file bytes, each padded to a full sector
+    static const uint8_t padding[SECTOR_SIZE] = { 0 };
+    size_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (segments[i].file_size != 0) {
+            fwrite(segments[i].data, 1, segments[i].file_size, out);
+        }
+        fwrite(padding, 1, (SECTOR_SIZE - segments[i].file_size % SECTOR_SIZE) % SECTOR_SIZE, out);
+        total += (segments[i].file_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+        printf(
+            "mkimage: segment %u at 0x%08x, %u bytes (%u in memory)\n",
+            i, segments[i].addr, segments[i].file_size, segments[i].mem_size);
+    }
+
+    printf("mkimage: %u segments, %zu sectors + header\n", count, total);
+
+    if (fclose(out) != 0) {
+        fail("cannot write output");
+    }
+
+    return 0;
+}